@@ -5,9 +5,53 @@
 #define __COLLISION_H_
 
 #include <ld33/game.h>
+#include <ld33/mob.h>
+
+/**
+ * Clear the broadphase used by moving objects; Must be called before anything
+ * is collided on a frame. Changing pGame->broadphase only takes effect here
+ */
+gfmRV collide_initFrame(gameCtx *pGame, int x, int width, int height);
+
+/**
+ * Clear the view layer, which keeps every mob's position on the start of the
+ * frame, so mobs may look for each other without colliding anything
+ */
+gfmRV collide_initView(gameCtx *pGame, int x, int width, int height);
+gfmRV collide_addViewSpr(gfmSprite *pSpr, gameCtx *pGame);
+
+/**
+ * Retrieve every mob within a rectangle; The list is only valid until the next
+ * query
+ */
+gfmRV collide_queryView(mob ***pppMobs, int *pNum, gameCtx *pGame, int x,
+        int y, int width, int height);
 
 gfmRV collide_obj(gfmObject *pObj, gameCtx *pGame);
 gfmRV collide_spr(gfmSprite *pSpr, gameCtx *pGame);
 
+/**
+ * Solve every overlap found by collide_obj/collide_spr since the last flush;
+ * The pairs are tested in parallel and every response (pushing mobs out of
+ * walls, hits and winning) is applied afterwards, in an order that doesn't
+ * depend on how the objects were inserted. Must be called once every object
+ * was collided on a frame
+ */
+gfmRV collide_flush(gameCtx *pGame);
+
+/**
+ * Release the memory used to store the pairs found on each frame
+ */
+gfmRV collide_free();
+
+/**
+ * Prepare the static layer for a new world; Everything that never moves should
+ * be added to it once, instead of being re-inserted on the quadtree every frame
+ */
+gfmRV collide_initStatic(gameCtx *pGame, int width, int height);
+gfmRV collide_addStaticObj(gfmObject *pObj, gameCtx *pGame);
+gfmRV collide_addStaticSpr(gfmSprite *pSpr, gameCtx *pGame);
+gfmRV collide_removeStaticSpr(gfmSprite *pSpr, gameCtx *pGame);
+
 #endif /* __COLLISION_H_ */
 
@@ -0,0 +1,72 @@
+/**
+ * @file include/ld33/flowfield.h
+ *
+ * Coarse grid over (part of) the level that stores every cell's distance to a
+ * target (i.e., the player); It's only recalculated when the target changes
+ * cells or when an obstacle is added, and may then be sampled by any number of
+ * mobs to find which way to go (either to or away from the target), going
+ * around obstacles
+ */
+#ifndef __FLOWFIELD_H__
+#define __FLOWFIELD_H__
+
+#include <GFraMe/gfmError.h>
+
+/** 'Export' the flowfield struct */
+typedef struct stFlowfield flowfield;
+
+/**
+ * Alloc a new flowfield
+ */
+gfmRV flowfield_getNew(flowfield **ppField);
+
+/**
+ * Free a flowfield's memory
+ */
+gfmRV flowfield_free(flowfield **ppField);
+
+/**
+ * (Re)Initialize the field's dimensions and remove every obstacle from it;
+ * Previously alloc'ed memory is reused, if possible
+ *
+ * @param  pField   The flowfield
+ * @param  x        Field's horizontal position
+ * @param  y        Field's vertical position
+ * @param  width    Field's width
+ * @param  height   Field's height
+ * @param  cellSize Width and height of each cell
+ */
+gfmRV flowfield_init(flowfield *pField, int x, int y, int width, int height,
+        int cellSize);
+
+/**
+ * Mark every cell touched by a rectangle as impassable
+ */
+gfmRV flowfield_block(flowfield *pField, int x, int y, int width, int height);
+
+/**
+ * Set the position everything flows to; The distances are only recalculated
+ * if it's on a different cell (or if an obstacle was added)
+ *
+ * @param  pField The flowfield
+ * @param  x      Target's horizontal position
+ * @param  y      Target's vertical position
+ */
+gfmRV flowfield_update(flowfield *pField, int x, int y);
+
+/**
+ * Get which way to go from a position; Both directions are 0 if the position
+ * can't reach the target (or is already on its cell)
+ *
+ * @param  pDirX      Horizontal direction (-1, 0 or 1)
+ * @param  pDirY      Vertical direction (-1, 0 or 1)
+ * @param  pField     The flowfield
+ * @param  x          Horizontal position
+ * @param  y          Vertical position
+ * @param  isFleeing  Whether the direction should lead away from the target
+ */
+gfmRV flowfield_getDirection(int *pDirX, int *pDirY, flowfield *pField, int x,
+        int y, int isFleeing);
+
+#endif /* __FLOWFIELD_H__ */
+
@@ -18,6 +18,12 @@
 #include <GFraMe/gfmSpriteset.h>
 #include <GFraMe/gfmTypes.h>
 
+#include <ld33/flowfield.h>
+#include <ld33/grid.h>
+#include <ld33/jobs.h>
+#include <ld33/music.h>
+#include <ld33/sfx.h>
+
 /** Types... */
 #define player       gfmType_reserved_2
 #define npc          gfmType_reserved_3
@@ -40,13 +46,25 @@ enum enStateTypes {
 };
 typedef enum enStateTypes stateTypes;
 
+/** Structures that may be used to find overlaps between moving objects */
+enum enBroadphaseTypes {
+    broadphase_quadtree = 0,
+    broadphase_grid,
+    broadphase_max
+};
+typedef enum enBroadphaseTypes broadphaseTypes;
+
 /**  */
 struct stGameCtx {
     /** The library's main context */
     gfmCtx *pCtx;
-    /** Array of objects */
+    /** Array of objects; Used as the level's hitboxes, which are kept (and
+     * reused by recycled mobs) across restarts and only reset when the
+     * playstate is freed, as the game exits */
     gfmGenArr_var(gfmObject, pObjs);
-    /** Group for rendering everything */
+    /** Only allocates the mobs' sprites (see mob_init); It's never updated nor
+     * drawn as a whole, since playstate_drawMobs culls and sorts the mobs
+     * itself */
     gfmGroup *pRender;
     /** 4x4 spriteset */
     gfmSpriteset *pSset4x4;
@@ -58,6 +76,22 @@ struct stGameCtx {
     gfmSpriteset *pSset256x128;
     /** The game's quadtree */
     gfmQuadtreeRoot *pQt;
+    /** Static collision layer (world bounds and walls), built once per level */
+    grid *pStatic;
+    /** Every mob's position, for perception queries */
+    grid *pView;
+    /** Uniform grid for moving objects (alternative to the quadtree) */
+    grid *pGrid;
+    /** Distance to the player, shared by every shadow to find its way */
+    flowfield *pFlow;
+    /** Workers that run the parallel parts of a frame */
+    jobSystem *pJobs;
+    /** Merges and limits every sound effect played on a frame */
+    sfx *pSfx;
+    /** Background music, synthesized while it plays */
+    music *pMusic;
+    /** Which structure is used for moving objects */
+    broadphaseTypes broadphase;
     /** Pointer to the current state's struct */
     void *pState;
     /** Definition of the current state's type */
@@ -66,6 +100,14 @@ struct stGameCtx {
     int quitState;
     /** Maximum number of particles on screen */
     int maxParts;
+    /** Distance around the camera within which mobs are kept awake (from
+     * -margin) */
+    int sleepMargin;
+    /** How many threads update the mobs (from -threads; 0 uses every
+     * processor) */
+    int numThreads;
+    /** Level to be loaded instead of the default one (from -level) */
+    char *pLevelPath;
     /** PRNG seed */
     unsigned int seed;
     int didLose;
@@ -77,6 +119,7 @@ struct stGameCtx {
     int handle_up;
     int handle_atk;
     int handle_quit;
+    int handle_broadphase;
     /** Input states */
     gfmInputState state_down;
     int num_down;
@@ -90,9 +133,10 @@ struct stGameCtx {
     int num_atk;
     gfmInputState state_quit;
     int num_quit;
+    gfmInputState state_broadphase;
+    int num_broadphase;
     /** Audios */
     int audioFreq;
-    int song;
     int expl;
     int wall_hit;
     int slime_hit;
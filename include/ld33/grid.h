@@ -0,0 +1,132 @@
+/**
+ * @file include/ld33/grid.h
+ *
+ * Uniform grid of fixed-size cells; Objects are indexed on every cell they
+ * touch and may be checked against everything already on the grid. Overlaps
+ * are reported the same way gfmQuadtree does it (i.e., by returning
+ * GFMRV_QUADTREE_OVERLAPED and iterating through getOverlaping/continue)
+ *
+ * Every object has a category and a mask (both bitmasks); A pair is only
+ * reported if each object's category is on the other's mask
+ */
+#ifndef __GRID_H__
+#define __GRID_H__
+
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmObject.h>
+#include <GFraMe/gfmSprite.h>
+
+/** 'Export' the grid struct */
+typedef struct stGrid grid;
+
+/**
+ * Alloc a new grid
+ */
+gfmRV grid_getNew(grid **ppGrid);
+
+/**
+ * Free a grid's memory
+ */
+gfmRV grid_free(grid **ppGrid);
+
+/**
+ * (Re)Initialize the grid's dimensions and remove every object from it;
+ * Previously alloc'ed memory is reused, if possible
+ *
+ * @param  pGrid      The grid
+ * @param  x          Grid's horizontal position
+ * @param  y          Grid's vertical position
+ * @param  width      Grid's width
+ * @param  height     Grid's height
+ * @param  cellWidth  Width of each cell
+ * @param  cellHeight Height of each cell
+ */
+gfmRV grid_init(grid *pGrid, int x, int y, int width, int height,
+        int cellWidth, int cellHeight);
+
+/**
+ * Remove every object from the grid (but keep its dimensions and memory)
+ */
+gfmRV grid_reset(grid *pGrid);
+
+/**
+ * Add an object to the grid, without checking for overlaps; Objects completely
+ * outside the grid (with a cell of tolerance) are ignored
+ *
+ * @param  pGrid    The grid
+ * @param  pObj     The object
+ * @param  category Bits that identify the object
+ * @param  mask     Categories that the object may overlap
+ */
+gfmRV grid_populateObject(grid *pGrid, gfmObject *pObj, int category,
+        int mask);
+
+/**
+ * Add a sprite to the grid, without checking for overlaps
+ */
+gfmRV grid_populateSprite(grid *pGrid, gfmSprite *pSpr, int category,
+        int mask);
+
+/**
+ * Remove an object from the grid (e.g., a wall that was destroyed); The object
+ * must still be at the position where it was added
+ */
+gfmRV grid_removeObject(grid *pGrid, gfmObject *pObj);
+
+/**
+ * Check an object against everything on the grid, without adding it
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_queryObject(grid *pGrid, gfmObject *pObj, int category, int mask);
+
+/**
+ * Add an object to the grid and check it against everything that was already
+ * on it (same as gfmQuadtree_collideObject)
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_collideObject(grid *pGrid, gfmObject *pObj, int category,
+        int mask);
+
+/**
+ * Add a sprite to the grid and check it against everything on it
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_collideSprite(grid *pGrid, gfmSprite *pSpr, int category,
+        int mask);
+
+/**
+ * Retrieve every object within a rectangle, without adding anything to the
+ * grid; The returned list is owned by the grid and is only valid until the
+ * next query
+ *
+ * @param  pppObjs The objects found
+ * @param  pNum    How many objects were found
+ * @param  pGrid   The grid
+ * @param  x       Rectangle's horizontal position
+ * @param  y       Rectangle's vertical position
+ * @param  width   Rectangle's width
+ * @param  height  Rectangle's height
+ * @param  mask    Categories that should be retrieved
+ */
+gfmRV grid_queryRect(gfmObject ***pppObjs, int *pNum, grid *pGrid, int x,
+        int y, int width, int height, int mask);
+
+/**
+ * Retrieve the current overlaping pair; The first object is always the one
+ * that was being checked
+ */
+gfmRV grid_getOverlaping(gfmObject **ppObj1, gfmObject **ppObj2,
+        grid *pGrid);
+
+/**
+ * Continue looking for overlaps
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_continue(grid *pGrid);
+
+#endif /* __GRID_H__ */
+
@@ -0,0 +1,69 @@
+/**
+ * @file include/ld33/jobs.h
+ *
+ * Fixed pool of worker threads that split loops between themselves; Each
+ * worker (and the thread that started the loop) has its own queue of ranges
+ * and, when it runs out of work, steals from the others'. Without threads
+ * (e.g., on the browser), every loop simply runs on the calling thread
+ */
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <GFraMe/gfmError.h>
+
+/** 'Export' the job system struct */
+typedef struct stJobSystem jobSystem;
+
+/**
+ * Function called for each range of a loop; It may be called from any thread
+ * (and concurrently with other ranges), so it must only write to whatever
+ * belongs to its range
+ *
+ * @param  pCtx  Context passed to jobs_parallelFor
+ * @param  first First index on the range
+ * @param  last  Index after the last one on the range
+ */
+typedef gfmRV (*jobFunc)(void *pCtx, int first, int last);
+
+/**
+ * Alloc a new job system and start its workers
+ *
+ * @param  ppJobs     The job system
+ * @param  numWorkers How many threads are spawned (besides the calling one);
+ *                    If 0 (or if threads aren't available), every loop is run
+ *                    serially
+ */
+gfmRV jobs_getNew(jobSystem **ppJobs, int numWorkers);
+
+/**
+ * Stop every worker and free the job system's memory
+ */
+gfmRV jobs_free(jobSystem **ppJobs);
+
+/**
+ * Split a loop into ranges and run them on every thread; Only returns after
+ * every range was run
+ *
+ * @param  pJobs The job system (if NULL, the loop runs serially)
+ * @param  func  Function called for each range
+ * @param  pCtx  Context passed to the function
+ * @param  num   How many indices there are on the loop
+ * @param  grain Maximum number of indices on each range; Loops no longer than
+ *               this run serially
+ * @return The first error returned by any range, or GFMRV_OK
+ */
+gfmRV jobs_parallelFor(jobSystem *pJobs, jobFunc func, void *pCtx, int num,
+        int grain);
+
+/**
+ * Get how many threads run each loop (including the calling one)
+ */
+int jobs_getThreadCount(jobSystem *pJobs);
+
+/**
+ * Get how many processors are online (1, if it can't be detected)
+ */
+int jobs_getCpuCount();
+
+#endif /* __JOBS_H__ */
+
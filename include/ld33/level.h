@@ -0,0 +1,134 @@
+/**
+ * @file include/ld33/level.h
+ *
+ * Parsed level; Keeps every area and spawn point read from the map, so the
+ * playstate may be restarted without parsing it again
+ */
+#ifndef __LEVEL_H__
+#define __LEVEL_H__
+
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmError.h>
+
+/** 'Export' the level struct */
+typedef struct stLevel level;
+
+/** A static area (either the world's bounds or the goal) */
+struct stLevelArea {
+    /** Area's type (i.e., collideable or win) */
+    int type;
+    int x;
+    int y;
+    int width;
+    int height;
+};
+typedef struct stLevelArea levelArea;
+
+/** Where (and how) a mob should be spawned */
+struct stLevelSpawn {
+    /** Mob's type (i.e., player, shadow or wall) */
+    int type;
+    int x;
+    int y;
+    /** Mob's level (defines its health and attack) */
+    int level;
+    /** Shadow's subtype (e.g., EN_SLIME) */
+    int subtype;
+    /** Shadow's traits (e.g., TR_COWARD) */
+    int traits;
+    /** Distance the shadow keeps from the player */
+    int dist;
+};
+typedef struct stLevelSpawn levelSpawn;
+
+/**
+ * Alloc a new level
+ */
+gfmRV level_getNew(level **ppLevel);
+
+/**
+ * Free a level's memory
+ */
+gfmRV level_free(level **ppLevel);
+
+/**
+ * Parse a map and store everything on it
+ *
+ * @param  pLevel    The level
+ * @param  pCtx      The game's context
+ * @param  pFilename The map's filename (within the assets directory)
+ */
+gfmRV level_loadStatic(level *pLevel, gfmCtx *pCtx, char *pFilename);
+
+/**
+ * Load a level compiled by tools/mapc.c; The whole file is read at once and
+ * the records are decoded directly into the spawn tables
+ *
+ * @param  pLevel    The level
+ * @param  pCtx      The game's context
+ * @param  pFilename The compiled level's filename (within the assets
+ *                   directory)
+ */
+gfmRV level_loadBinary(level *pLevel, gfmCtx *pCtx, char *pFilename);
+
+/**
+ * Load a text level (same format as map.gfm) from the filesystem; The file is
+ * mapped read-only into memory and tokenized in place, without copying any
+ * token (if mapping isn't available, it's read into a buffer in a single go)
+ *
+ * @param  pLevel The level
+ * @param  pPath  Path to the level (not within the assets directory)
+ */
+gfmRV level_loadMapped(level *pLevel, char *pPath);
+
+/**
+ * Split the level into horizontal chunks, so spawns may be retrieved only
+ * around the camera; Must be called after loading the level
+ * 
+ * @param  pLevel     The level
+ * @param  chunkWidth Width of each chunk
+ */
+gfmRV level_indexChunks(level *pLevel, int chunkWidth);
+
+/**
+ * Get how many chunks the level was split into
+ */
+int level_getChunkCount(level *pLevel);
+
+/**
+ * Get the index (on the list from level_getSpawns) of every spawn within a
+ * chunk
+ * 
+ * @param  ppIndices The indices; The list is owned by the level
+ * @param  pNum      How many spawns there are on the chunk
+ * @param  pLevel    The level
+ * @param  chunk     The chunk
+ */
+gfmRV level_getChunkSpawns(int **ppIndices, int *pNum, level *pLevel,
+        int chunk);
+
+/**
+ * Check whether a map was already loaded
+ *
+ * @return GFMRV_TRUE, GFMRV_FALSE
+ */
+gfmRV level_isLoaded(level *pLevel);
+
+/**
+ * Get the world's dimensions
+ */
+gfmRV level_getDimensions(int *pWidth, int *pHeight, level *pLevel);
+
+/**
+ * Get every static area; The list is owned by the level
+ */
+gfmRV level_getAreas(levelArea **ppAreas, int *pNum, level *pLevel);
+
+/**
+ * Get every spawn point, in the order they were parsed; The list is owned by
+ * the level
+ */
+gfmRV level_getSpawns(levelSpawn **ppSpawns, int *pNum, level *pLevel);
+
+#endif /* __LEVEL_H__ */
+
@@ -0,0 +1,43 @@
+/**
+ * @file include/ld33/levelfmt.h
+ *
+ * Layout of a compiled level (as generated by tools/mapc.c); Every field is a
+ * little-endian 32 bits integer, so the file may be read in a single go and
+ * decoded without any string comparison
+ *
+ * The file starts with a header:
+ *   magic, version, width, height, numAreas, numSpawns
+ * followed by numAreas area records:
+ *   type, x, y, width, height
+ * followed by numSpawns spawn records:
+ *   type, x, y, level, subtype, traits, dist
+ *
+ * Types are stored as LVL_* codes (instead of the game's types, which depend
+ * on the framework); subtypes and traits are the game's EN_* and TR_* values
+ */
+#ifndef __LEVELFMT_H__
+#define __LEVELFMT_H__
+
+/** "LD3L", when read as a little-endian integer */
+#define LVL_MAGIC    0x4c33444c
+#define LVL_VERSION  1
+
+/** Number of fields on each record */
+#define LVL_HEADER_FIELDS 6
+#define LVL_AREA_FIELDS   5
+#define LVL_SPAWN_FIELDS  7
+
+/** Size of each field, in bytes */
+#define LVL_FIELD_SIZE 4
+
+enum enLevelCodes {
+    LVL_AREA_COLLIDEABLE = 0,
+    LVL_AREA_WIN,
+    LVL_OBJ_PLAYER,
+    LVL_OBJ_SHADOW,
+    LVL_OBJ_WALL,
+    LVL_MAX
+};
+
+#endif /* __LEVELFMT_H__ */
+
@@ -12,6 +12,8 @@
 
 /** 'Export' the mob struct */
 typedef struct stMob mob;
+/** 'Export' the mob pool struct */
+typedef struct stMobPool mobPool;
 
 enum {
     EN_NONE = 0,
@@ -31,13 +33,77 @@ enum {
 };
 
 /**
- * Alloc a new mob
+ * Alloc a new pool of mobs
  */
-gfmRV mob_getNew(mob **ppMob);
+gfmRV mobPool_getNew(mobPool **ppPool);
+
+/**
+ * Free a pool and every mob on it
+ */
+gfmRV mobPool_free(mobPool **ppPool);
+
+/**
+ * Release every mob; They are all moved to the free list, so their sprites and
+ * hitboxes are reused (in the same order they were first retrieved), and are
+ * parked out of the world until then
+ */
+gfmRV mobPool_reset(mobPool *pPool);
+
+/**
+ * Retrieve an unused mob from the pool and add it to the active list; Dead
+ * mobs are reused first (keeping their sprite and hitbox, so mob_init won't
+ * request new ones), otherwise the pool is expanded as necessary; Mobs are
+ * alloc'ed in chunks, so a mob's address never changes (even after expanding)
+ * 
+ * @param  ppMob The retrieved mob (already zeroed)
+ * @param  pPool The pool
+ */
+gfmRV mobPool_getNext(mob **ppMob, mobPool *pPool);
+
+/**
+ * Get how many mobs are in use
+ */
+int mobPool_getUsed(mobPool *pPool);
+
+/**
+ * Get a mob from the pool
+ * 
+ * @param  pPool The pool
+ * @param  i     The mob's index (must be less than mobPool_getUsed)
+ */
+mob* mobPool_getMob(mobPool *pPool, int i);
+
+/**
+ * Remove every dead mob from the active list; Its position is filled by the
+ * last active mob, so the list order isn't kept
+ */
+gfmRV mobPool_compact(mobPool *pPool);
+
 /**
- * Free a mob's memory
+ * Get how many mobs are alive
  */
-gfmRV mob_free(mob **ppMob);
+int mobPool_getActiveCount(mobPool *pPool);
+
+/**
+ * Get a mob from the active list
+ * 
+ * @param  pPool The pool
+ * @param  i     Index on the active list (must be less than
+ *               mobPool_getActiveCount)
+ */
+mob* mobPool_getActive(mobPool *pPool, int i);
+
+/**
+ * Update every living shadow on a list in a single batch; Anything else on the
+ * list is skipped (and should be updated by mob_update)
+ * 
+ * @param  pPool  The pool (which keeps the batch's memory)
+ * @param  ppMobs The mobs
+ * @param  num    How many mobs there are
+ * @param  pGame  The game's context
+ */
+gfmRV mobPool_updateShadows(mobPool *pPool, mob **ppMobs, int num,
+        gameCtx *pGame);
 
 /**
  * Initializa a mob; To ease memory management, it doesn't alloc memory;
@@ -53,27 +119,85 @@ gfmRV mob_setAnimations(mob *pMob, int subtype);
 
 gfmRV mob_setPosition(mob *pMob, int x, int y);
 
+gfmRV mob_getPosition(int *pX, int *pY, mob *pMob);
+
+gfmRV mob_getDimensions(int *pWidth, int *pHeight, mob *pMob);
+
+/**
+ * Store which of the level's spawns created this mob
+ */
+gfmRV mob_setSpawnId(mob *pMob, int spawnId);
+
+/**
+ * Get which of the level's spawns created this mob (-1 if none)
+ */
+int mob_getSpawnId(mob *pMob);
+
+/**
+ * Remove a mob from the world without killing it (e.g., because it's too far
+ * from the camera); Its sprite is hidden until it's reused by another mob
+ */
+gfmRV mob_despawn(mob *pMob, gameCtx *pGame);
+
 gfmRV mob_setTraits(mob *pMob, int traits);
 
 gfmRV mob_setDist(mob *pMob, int dist);
 
 /**
- * Update the sprite and add it to the quadtree
+ * Add the mob to the static collision layer, if it never moves (i.e., walls)
+ */
+gfmRV mob_populateStatic(mob *pMob, gameCtx *pGame);
+
+/**
+ * Add the mob to the view layer, so others may find it
+ */
+gfmRV mob_populateView(mob *pMob, gameCtx *pGame);
+
+/**
+ * Advance the mob's AI (or read the player's input), tick its dash and
+ * invulnerability timers and set its animation; Shadows are handled as a batch
+ * of one (see mobPool_updateShadows). The sprite itself is only moved by
+ * mob_updateSprite, and collision is handled separately
  */
 gfmRV mob_update(mob *pMob, gameCtx *pGame);
 
+/**
+ * Update the mob's sprite (i.e., its physics and animation); Replaces updating
+ * the whole render group, so mobs that are asleep may be skipped
+ */
+gfmRV mob_updateSprite(mob *pMob, gameCtx *pGame);
+
 gfmRV mob_postUpdate(mob *pMob, gameCtx *pGame);
 
 gfmRV mob_draw(mob *pMob, gameCtx *pGame);
 
+/**
+ * Check whether any of the mob's frame (i.e., its sprite's offset and tile,
+ * not only its hitbox) is within a rectangle (e.g., the camera)
+ * 
+ * @return GFMRV_TRUE, GFMRV_FALSE
+ */
+gfmRV mob_isOnCamera(mob *pMob, int x, int y, int width, int height);
+
 gfmRV mob_isVulnerable(mob *pMob);
 
 gfmRV mob_getType(int *pType, mob *pMob);
 
 gfmRV mob_setOnView(mob *pSelf, mob *pMob);
 
-/** pSelf attacks pMob */
-gfmRV mob_attack(mob *pSelf, mob *pMob, gameCtx *pGame);
+/**
+ * Record that pSelf hit pMob on this frame; Only the strongest hit is kept, and
+ * it's only applied by mob_resolveHits
+ * 
+ * @return GFMRV_TRUE (if it's the first hit on pMob this frame), GFMRV_FALSE
+ */
+gfmRV mob_addHit(mob *pSelf, mob *pMob);
+
+/**
+ * Apply the strongest hit recorded on a mob (if any) as a single attack (i.e.,
+ * a single animation change and sound)
+ */
+gfmRV mob_resolveHits(mob *pMob, gameCtx *pGame);
 
 gfmRV mob_isAlive(mob *pMob);
 
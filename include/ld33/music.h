@@ -0,0 +1,46 @@
+/**
+ * @file include/ld33/music.h
+ *
+ * Background music, synthesized from its MML source while it plays; Samples
+ * are rendered in small blocks into a ring buffer, only when the audio device
+ * asks for more, so the song is never kept decoded in memory
+ */
+#ifndef __MUSIC_H__
+#define __MUSIC_H__
+
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmError.h>
+
+/** 'Export' the music struct */
+typedef struct stMusic music;
+
+/**
+ * Alloc a new music player
+ */
+gfmRV music_getNew(music **ppMusic);
+
+/**
+ * Stop the music (if playing) and free its memory
+ */
+gfmRV music_free(music **ppMusic);
+
+/**
+ * Load and compile a song
+ *
+ * @param  pMusic    The music player
+ * @param  pCtx      The game's context
+ * @param  pFilename The song's source (within the assets directory)
+ * @param  freq      Sample rate the song is rendered at
+ */
+gfmRV music_load(music *pMusic, gfmCtx *pCtx, char *pFilename, int freq);
+
+/**
+ * Open an audio device and start playing the song (looping it)
+ *
+ * @param  pMusic The music player
+ * @param  volume The song's volume (from 0.0 to 1.0)
+ */
+gfmRV music_play(music *pMusic, double volume);
+
+#endif /* __MUSIC_H__ */
+
@@ -0,0 +1,113 @@
+/**
+ * @file include/ld33/particles.h
+ *
+ * Lightweight particles (e.g., the falling leaves); Each particle is only a
+ * position, a velocity, a time to live and a frame, kept on flat arrays (one
+ * per field), so thousands of them may be updated by a few tight loops
+ * instead of as full sprites. Every particle shares the same acceleration and
+ * spriteset
+ */
+#ifndef __PARTICLES_H__
+#define __PARTICLES_H__
+
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmSpriteset.h>
+
+/** 'Export' the particles struct */
+typedef struct stParticles particles;
+
+/** Where and how a batch of particles is spawned; Each particle gets a random
+ * value from every range (with both limits included) */
+struct stParticleEmitter {
+    /** Area where the particles are spawned */
+    int x;
+    int y;
+    int width;
+    int height;
+    /** Whether the area is relative to the camera (instead of the world) */
+    int isCameraRelative;
+    /** Range of velocities */
+    int minVx;
+    int maxVx;
+    int minVy;
+    int maxVy;
+    /** Range of tiles */
+    int firstTile;
+    int lastTile;
+    /** Range of times to live, in milliseconds (if both are 0, the system's
+     * default is used) */
+    int minTtl;
+    int maxTtl;
+};
+typedef struct stParticleEmitter particleEmitter;
+
+/**
+ * Alloc a new particle system
+ *
+ * @param  ppParts  The particle system
+ * @param  maxParts How many particles may be alive at once
+ */
+gfmRV particles_getNew(particles **ppParts, int maxParts);
+
+/**
+ * Free the particle system's memory
+ */
+gfmRV particles_free(particles **ppParts);
+
+/**
+ * Set how every particle looks and moves
+ *
+ * @param  pParts The particle system
+ * @param  pSset  Spriteset used to draw the particles
+ * @param  width  Particles' width (used to cull them)
+ * @param  height Particles' height (used to cull them)
+ * @param  ax     Horizontal acceleration
+ * @param  ay     Vertical acceleration
+ * @param  ttl    How long each particle lives, in milliseconds (by default)
+ * @param  seed   Seed for the randomness on emitted batches
+ */
+gfmRV particles_init(particles *pParts, gfmSpriteset *pSset, int width,
+        int height, int ax, int ay, int ttl, unsigned int seed);
+
+/**
+ * Set whether particles are retired as soon as they leave the camera (instead
+ * of living until their time is up)
+ *
+ * @param  pParts The particle system
+ * @param  margin How far outside the camera particles may go before being
+ *                retired; If negative, they are never retired
+ */
+gfmRV particles_setDeathOnLeave(particles *pParts, int margin);
+
+/**
+ * Add a batch of particles at once; If there isn't enough room, only as many
+ * particles as fit are added
+ *
+ * @param  pParts   The particle system
+ * @param  pCtx     The game's context
+ * @param  pEmitter Where and how the particles are spawned
+ * @param  num      How many particles should be spawned
+ */
+gfmRV particles_emitBatch(particles *pParts, gfmCtx *pCtx,
+        const particleEmitter *pEmitter, int num);
+
+/**
+ * Move every particle and remove the ones whose time is up (or that left the
+ * camera, if set to do so)
+ *
+ * @param  pParts The particle system
+ * @param  pCtx   The game's context
+ */
+gfmRV particles_update(particles *pParts, gfmCtx *pCtx);
+
+/**
+ * Draw every particle within the camera
+ *
+ * @param  pParts The particle system
+ * @param  pCtx   The game's context
+ */
+gfmRV particles_draw(particles *pParts, gfmCtx *pCtx);
+
+#endif /* __PARTICLES_H__ */
+
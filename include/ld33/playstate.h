@@ -10,10 +10,28 @@
 
 gfmRV playstate_setWin(gameCtx *pGame);
 
+/**
+ * Burst a batch of particles out of an area (e.g., a mob that just died)
+ *
+ * @param  pGame  The game
+ * @param  x      Area's horizontal position
+ * @param  y      Area's vertical position
+ * @param  width  Area's width
+ * @param  height Area's height
+ * @param  num    How many particles are spawned
+ */
+gfmRV playstate_burst(gameCtx *pGame, int x, int y, int width, int height,
+        int num);
+
 /**
  * Initialize the playstate and loop it
  */
 gfmRV playstate_loop(gameCtx *pGame);
 
+/**
+ * Release everything kept between runs
+ */
+gfmRV playstate_free(gameCtx *pGame);
+
 #endif /* __PLAYSTATE_H__ */
 
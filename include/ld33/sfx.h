@@ -0,0 +1,85 @@
+/**
+ * @file include/ld33/sfx.h
+ *
+ * Sound effects layer; Sounds requested during a frame are only played once
+ * the frame is flushed, so any number of requests for the same sound become a
+ * single voice. Each sound may only have a few voices playing at once (and
+ * there's a global limit, as well); When every voice is busy, a new sound
+ * steals the voice of a less important one or is dropped
+ */
+#ifndef __SFX_H__
+#define __SFX_H__
+
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmError.h>
+
+/** 'Export' the sound effects struct */
+typedef struct stSfx sfx;
+
+/** Every sound effect that may be requested */
+enum enSfxId {
+    SFX_EXPL = 0,
+    SFX_WALL_HIT,
+    SFX_SLIME_HIT,
+    SFX_SLIME_DEATH,
+    SFX_PL_HIT,
+    SFX_PL_DEATH,
+    SFX_MAX
+};
+typedef enum enSfxId sfxId;
+
+/**
+ * Alloc a new sound effects layer
+ *
+ * @param  ppSfx     The sound effects layer
+ * @param  maxVoices How many sound effects may be playing at once
+ */
+gfmRV sfx_getNew(sfx **ppSfx, int maxVoices);
+
+/**
+ * Free the sound effects layer's memory
+ */
+gfmRV sfx_free(sfx **ppSfx);
+
+/**
+ * Set the audio played by a sound effect and how it's limited
+ *
+ * @param  pSfx      The sound effects layer
+ * @param  id        The sound effect
+ * @param  handle    Audio's handle (from gfm_loadAudio)
+ * @param  priority  Sounds with greater priority may steal voices from lesser
+ *                   ones
+ * @param  maxVoices How many voices of this sound may be playing at once
+ * @param  length    Audio's duration, in milliseconds
+ */
+gfmRV sfx_setSound(sfx *pSfx, sfxId id, int handle, int priority,
+        int maxVoices, int length);
+
+/**
+ * Request a sound effect to be played on the next flush; Requests for the same
+ * sound are merged (and the loudest volume is kept)
+ *
+ * @param  pSfx   The sound effects layer
+ * @param  id     The sound effect
+ * @param  volume The sound's volume (from 0.0 to 1.0)
+ */
+gfmRV sfx_play(sfx *pSfx, sfxId id, double volume);
+
+/**
+ * Play every sound requested since the last flush, from the most important to
+ * the least one; Should be called once per frame
+ *
+ * @param  pSfx The sound effects layer
+ * @param  pCtx The game's context
+ */
+gfmRV sfx_flush(sfx *pSfx, gfmCtx *pCtx);
+
+/**
+ * Get how many requests were merged into another one and how many were
+ * dropped (either because there were no voices left or because their voice
+ * was stolen), since the layer was created
+ */
+gfmRV sfx_getStats(int *pMerged, int *pDropped, sfx *pSfx);
+
+#endif /* __SFX_H__ */
+
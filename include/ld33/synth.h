@@ -0,0 +1,67 @@
+/**
+ * @file include/ld33/synth.h
+ *
+ * Sequencer and synthesizer for songs written in MML (e.g., assets/mml/song.mml);
+ * The song is compiled once into a list of notes for each track, which are
+ * then rendered (and mixed) on demand, a few samples at a time
+ *
+ * Accepted commands (each track ends on a ';'):
+ *   t<n>        Tempo, in beats per minute (for the whole song)
+ *   @<n>        Wave (0: square, 1: noise, 2: triangle, 3: 25% pulse)
+ *   o<n> < >    Octave (set, one up, one down)
+ *   l<n>        Default note length (e.g., 4 for quarter notes)
+ *   q<n>        How many eights of each note are played (the rest is silent)
+ *   v<n>        Volume (from 0 to 15)
+ *   na<n>       Volume envelope (one of the tables), applied to every note
+ *   a-g, r      Note (accepts + and - for accidentals) or rest; May be followed
+ *               by a length, dots and ties (^)
+ *   [...|...]<n> Loop n times; Whatever comes after the '|' is skipped on the
+ *               last time
+ *   #TABLE n { v, (a, b)c, ... };
+ *               Envelope table, with values from 0 to 128, stepped 60 times
+ *               a second; (a, b)c is a ramp from a to b over c steps
+ *   #X=...;     Macro (any upper case letter), expanded wherever it's used
+ */
+#ifndef __SYNTH_H__
+#define __SYNTH_H__
+
+#include <GFraMe/gfmError.h>
+
+/** 'Export' the synth struct */
+typedef struct stSynth synth;
+
+/**
+ * Alloc a new synth
+ *
+ * @param  ppSynth The synth
+ * @param  freq    Sample rate of the rendered audio
+ */
+gfmRV synth_getNew(synth **ppSynth, int freq);
+
+/**
+ * Free the synth's memory
+ */
+gfmRV synth_free(synth **ppSynth);
+
+/**
+ * Compile a song; Any previously compiled song is discarded (but its memory is
+ * reused)
+ *
+ * @param  pSynth The synth
+ * @param  pText  The song's source (it isn't referenced after this returns)
+ * @param  len    Length of the source
+ */
+gfmRV synth_compile(synth *pSynth, char *pText, int len);
+
+/**
+ * Render the next samples of the song (mono, signed 16 bits); The song loops
+ * once every track is finished
+ *
+ * @param  pSynth The synth
+ * @param  pBuf   Where the samples are written
+ * @param  num    How many samples should be rendered
+ */
+gfmRV synth_render(synth *pSynth, short *pBuf, int num);
+
+#endif /* __SYNTH_H__ */
+
@@ -2,43 +2,283 @@
  * @file src/collision.c
  */
 #include <ld33/collision.h>
+#include <ld33/jobs.h>
 #include <ld33/mob.h>
 #include <ld33/playstate.h>
 
-static gfmRV collide_atkXMob(gfmObject *pAtk, mob *pMob, gameCtx *pGame) {
+#include <stdlib.h>
+
+/** What should be done about a pair, found by the narrowphase and applied only
+ * after every pair was tested */
+enum enCollideResponse {
+    /** Nothing (e.g., a mob's own attack hitting itself) */
+    resp_none = 0,
+    /** Push an object out of a wall */
+    resp_push,
+    /** Hurt a mob */
+    resp_attack,
+    /** Finish the level */
+    resp_win
+};
+typedef enum enCollideResponse collideResponse;
+
+/** A pair reported by the broadphase, and its deferred response */
+struct stCollidePair {
+    /** The pair, as reported */
+    gfmObject *pObj1;
+    gfmObject *pObj2;
+    /** Response found by the narrowphase */
+    collideResponse resp;
+    /** Object that receives the response (i.e., the one pushed or hurt) */
+    void *pTarget;
+    /** Mob that attacked (on resp_attack) */
+    mob *pSource;
+    /** How much the target is pushed (on resp_push) */
+    int dx;
+    int dy;
+};
+typedef struct stCollidePair collidePair;
+
+/**
+ * Signature of every narrowphase test; Objects are received in the order they
+ * were registered on the dispatch table. A sprite's child is its mob, while a
+ * hitbox's child is whatever it was initialized with (i.e., the mob that owns
+ * it, or NULL for the world's areas). It may run on any thread, so it must only
+ * read the objects and write to the pair
+ */
+typedef gfmRV (*collideFunc)(collidePair *pPair, gfmObject *pObj1,
+        void *pChild1, gfmObject *pObj2, void *pChild2);
+
+/** Entry on the dispatch table */
+struct stCollideEntry {
+    /** Test for the pair (NULL, if they don't interact) */
+    collideFunc func;
+    /** Whether the pair must be swapped before calling func */
+    int doSwap;
+};
+typedef struct stCollideEntry collideEntry;
+
+/** Every game type, from player to win, has an entry on the table */
+#define TYPE_FIRST player
+#define TYPE_COUNT (win - player + 1)
+#define IS_GAME_TYPE(type) ((type) >= TYPE_FIRST && \
+        (type) < TYPE_FIRST + TYPE_COUNT)
+
+/** Every type has its own category bit */
+#define TYPE_CATEGORY(type) (1 << ((type) - TYPE_FIRST))
+
+/** How many pairs are tested at once by each thread */
+#define PAIR_GRAIN 128
+
+/** Type-pair dispatch table */
+static collideEntry pDispatch[TYPE_COUNT][TYPE_COUNT];
+/** Categories each type may overlap (i.e., that has a response registered) */
+static int pTypeMask[TYPE_COUNT];
+static int isDispatchInit = 0;
+
+/** Every pair reported on the current frame (reused between frames) */
+static collidePair *pPairs = 0;
+static int pairsLen = 0;
+static int numPairs = 0;
+/** Every mob hit on the current frame (each only once) */
+static mob **ppVictims = 0;
+static int victimsLen = 0;
+static int numVictims = 0;
+
+static gfmRV collide_winXPlayer(collidePair *pPair, gfmObject *pWin,
+        void *pChild1, gfmObject *pPlayer, void *pChild2) {
+    pPair->resp = resp_win;
+    pPair->pTarget = pChild2;
+    
+    return GFMRV_OK;
+}
+
+static gfmRV collide_atkXMob(collidePair *pPair, gfmObject *pAtk, void *pSelf,
+        gfmObject *pObj, void *pMob) {
+    // Mobs don't hurt themselves
+    if (pSelf != pMob) {
+        pPair->resp = resp_attack;
+        pPair->pTarget = pMob;
+        pPair->pSource = (mob*)pSelf;
+    }
+    
+    return GFMRV_OK;
+}
+
+/**
+ * Push the mob out of the wall, through the axis with the least penetration
+ * (plus a small nudge, so it doesn't stick to the wall)
+ */
+static gfmRV collide_wallXMob(collidePair *pPair, gfmObject *pWall,
+        void *pChild1, gfmObject *pMob, void *pChild2) {
     gfmRV rv;
-    int type;
-    mob *pSelf;
+    int mh, mw, mx, my, ox, oy, wh, ww, wx, wy;
     
-    rv = gfmObject_getChild((void**)&pSelf, &type, pAtk);
+    rv = gfmObject_getPosition(&wx, &wy, pWall);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmObject_getDimensions(&ww, &wh, pWall);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmObject_getPosition(&mx, &my, pMob);
     ASSERT(rv == GFMRV_OK, rv);
-    if (pSelf == pMob) {
+    rv = gfmObject_getDimensions(&mw, &mh, pMob);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    ox = ((mx + mw < wx + ww) ? mx + mw : wx + ww) - ((mx > wx) ? mx : wx);
+    oy = ((my + mh < wy + wh) ? my + mh : wy + wh) - ((my > wy) ? my : wy);
+    if (ox <= 0 || oy <= 0) {
         rv = GFMRV_OK;
         goto __ret;
     }
     
-    rv = mob_attack(pSelf, pMob, pGame);
-    ASSERT(rv == GFMRV_OK, rv);
+    pPair->resp = resp_push;
+    pPair->pTarget = pMob;
+    pPair->dx = 0;
+    pPair->dy = 0;
+    if (ox < oy) {
+        if (mx * 2 + mw < wx * 2 + ww) {
+            pPair->dx = -ox;
+        }
+        else {
+            pPair->dx = ox + 1;
+        }
+    }
+    else {
+        if (my * 2 + mh < wy * 2 + wh) {
+            pPair->dy = -oy - 1;
+        }
+        else {
+            pPair->dy = oy + 2;
+        }
+    }
     
     rv = GFMRV_OK;
 __ret:
     return rv;
 }
 
-static gfmRV collide_scanXMob(gfmObject *pScan, mob *pMob) {
+/**
+ * Register a response on both orders of a pair (and let the broadphase report
+ * overlaps between those types)
+ */
+static void collide_setResponse(int type1, int type2, collideFunc func) {
+    collideEntry *pEntry;
+    
+    pTypeMask[type1 - TYPE_FIRST] |= TYPE_CATEGORY(type2);
+    pTypeMask[type2 - TYPE_FIRST] |= TYPE_CATEGORY(type1);
+    
+    pEntry = &(pDispatch[type1 - TYPE_FIRST][type2 - TYPE_FIRST]);
+    pEntry->func = func;
+    pEntry->doSwap = 0;
+    
+    pEntry = &(pDispatch[type2 - TYPE_FIRST][type1 - TYPE_FIRST]);
+    pEntry->func = func;
+    pEntry->doSwap = 1;
+}
+
+/**
+ * Fill the dispatch table; Every pair not registered here is ignored
+ */
+static void collide_initDispatch() {
+    collide_setResponse(win, player, collide_winXPlayer);
+    collide_setResponse(wall, player, collide_wallXMob);
+    collide_setResponse(wall, shadow, collide_wallXMob);
+    collide_setResponse(collideable, player, collide_wallXMob);
+    collide_setResponse(collideable, shadow, collide_wallXMob);
+    collide_setResponse(atk, player, collide_atkXMob);
+    collide_setResponse(atk, shadow, collide_atkXMob);
+    collide_setResponse(atk, wall, collide_atkXMob);
+    
+    isDispatchInit = 1;
+}
+
+/**
+ * Retrieve the collision category and mask of an object; Objects that don't
+ * belong to the game (or that don't interact with anything) get no bits at
+ * all, so the grids never report them
+ */
+static gfmRV collide_getFilter(int *pCategory, int *pMask, gfmObject *pObj) {
     gfmRV rv;
+    void *pChild;
     int type;
-    mob *pSelf;
     
-    // If the scanner is "scanning itself" or is the player, stop
-    rv = gfmObject_getChild((void**)&pSelf, &type, pScan);
+    if (!isDispatchInit) {
+        collide_initDispatch();
+    }
+    
+    rv = gfmObject_getChild(&pChild, &type, pObj);
     ASSERT(rv == GFMRV_OK, rv);
-    if (pSelf == pMob || type == player) {
+    if (type == gfmType_sprite) {
+        rv = gfmSprite_getChild(&pChild, &type, (gfmSprite*)pChild);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    
+    if (IS_GAME_TYPE(type)) {
+        *pCategory = TYPE_CATEGORY(type);
+        *pMask = pTypeMask[type - TYPE_FIRST];
+    }
+    else {
+        *pCategory = 0;
+        *pMask = 0;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Find the response to a pair of overlaping objects (without applying it)
+ */
+static gfmRV collide_testPair(collidePair *pPair) {
+    collideEntry *pEntry;
+    gfmObject *pObj1, *pObj2;
+    gfmRV rv;
+    void *pChild1, *pChild2;
+    int type1, type2;
+    
+    pObj1 = pPair->pObj1;
+    pObj2 = pPair->pObj2;
+    pPair->resp = resp_none;
+    
+    rv = gfmObject_getChild(&pChild1, &type1, pObj1);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmObject_getChild(&pChild2, &type2, pObj2);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Hitboxes are already typed, so pairs between them (the most common
+    // ones) are discarded without looking up any sprite
+    if (type1 != gfmType_sprite && type2 != gfmType_sprite) {
+        if (!IS_GAME_TYPE(type1) || !IS_GAME_TYPE(type2) ||
+                !pDispatch[type1 - TYPE_FIRST][type2 - TYPE_FIRST].func) {
+            rv = GFMRV_OK;
+            goto __ret;
+        }
+    }
+    
+    if (type1 == gfmType_sprite) {
+        rv = gfmSprite_getChild(&pChild1, &type1, (gfmSprite*)pChild1);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    if (type2 == gfmType_sprite) {
+        rv = gfmSprite_getChild(&pChild2, &type2, (gfmSprite*)pChild2);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    if (!IS_GAME_TYPE(type1) || !IS_GAME_TYPE(type2)) {
         rv = GFMRV_OK;
         goto __ret;
     }
     
-    rv = mob_setOnView(pSelf, pMob);
+    pEntry = &(pDispatch[type1 - TYPE_FIRST][type2 - TYPE_FIRST]);
+    if (!pEntry->func) {
+        // e.g., Collision between mob's hitboxes, do nothing!
+        rv = GFMRV_OK;
+    }
+    else if (pEntry->doSwap) {
+        rv = pEntry->func(pPair, pObj2, pChild2, pObj1, pChild1);
+    }
+    else {
+        rv = pEntry->func(pPair, pObj1, pChild1, pObj2, pChild2);
+    }
     ASSERT(rv == GFMRV_OK, rv);
     
     rv = GFMRV_OK;
@@ -46,102 +286,99 @@ __ret:
     return rv;
 }
 
-static gfmRV collide_mobXWall(gfmObject *pMob, gfmObject *pWall) {
-    gfmCollision dir;
+/**
+ * Test a range of the pair list; May run on any thread
+ */
+static gfmRV collide_testRange(void *pCtx, int first, int last) {
     gfmRV rv;
-    int x, y;
     
-    rv = gfmObject_collide(pMob, pWall);
-    ASSERT(rv == GFMRV_TRUE || rv == GFMRV_FALSE, rv);
+    rv = GFMRV_OK;
+    while (first < last && rv == GFMRV_OK) {
+        rv = collide_testPair(pPairs + first);
+        first++;
+    }
     
-    rv = gfmObject_getCurrentCollision(&dir, pMob);
-    ASSERT(rv == GFMRV_OK, rv);
-    rv =  gfmObject_getPosition(&x, &y, pMob);
-    ASSERT(rv == GFMRV_OK, rv);
+    return rv;
+}
+
+/**
+ * Order responses by type, then by target and then by source, so they are
+ * applied in the same order regardless of how the pairs were found
+ */
+static int collide_cmpPairs(const void *pA, const void *pB) {
+    const collidePair *pPairA, *pPairB;
+    
+    pPairA = (const collidePair*)pA;
+    pPairB = (const collidePair*)pB;
     
-    if (dir & gfmCollision_left) {
-        x += 1;
+    if (pPairA->resp != pPairB->resp) {
+        return (pPairA->resp < pPairB->resp) ? -1 : 1;
     }
-    else if (dir & gfmCollision_left) {
-        x -= 1;
+    if (pPairA->pTarget != pPairB->pTarget) {
+        return ((char*)pPairA->pTarget < (char*)pPairB->pTarget) ? -1 : 1;
     }
-    if (dir & gfmCollision_up) {
-        y += 2;
+    if (pPairA->pSource != pPairB->pSource) {
+        return ((char*)pPairA->pSource < (char*)pPairB->pSource) ? -1 : 1;
     }
-    else if (dir & gfmCollision_down) {
-        y -= 1;
+    return 0;
+}
+
+/**
+ * Store a pair to be tested when the frame is flushed
+ */
+static gfmRV collide_pushPair(gfmObject *pObj1, gfmObject *pObj2) {
+    gfmRV rv;
+    
+    if (numPairs >= pairsLen) {
+        collidePair *pTmp;
+        
+        pTmp = (collidePair*)realloc(pPairs, sizeof(collidePair) *
+                (pairsLen * 2 + 64));
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pPairs = pTmp;
+        pairsLen = pairsLen * 2 + 64;
     }
     
-    rv = gfmObject_setPosition(pMob, x, y);
+    pPairs[numPairs].pObj1 = pObj1;
+    pPairs[numPairs].pObj2 = pObj2;
+    pPairs[numPairs].resp = resp_none;
+    pPairs[numPairs].pTarget = 0;
+    pPairs[numPairs].pSource = 0;
+    numPairs++;
+    
+    rv = GFMRV_OK;
 __ret:
     return rv;
 }
 
-static gfmRV doCollide(gameCtx *pGame) {
+/**
+ * Store every overlap reported by a broadphase (to be solved on
+ * collide_flush); If no grid is supplied, the quadtree is used
+ */
+static gfmRV doCollide(gameCtx *pGame, grid *pGrid) {
     gfmRV rv;
     
     rv = GFMRV_QUADTREE_OVERLAPED;
     while (rv != GFMRV_QUADTREE_DONE) {
         gfmObject *pObj1, *pObj2;
-        gfmSprite *pSpr1, *pSpr2;
-        mob *pMob1, *pMob2;
-        int type1, type2;
         
-        rv = gfmQuadtree_getOverlaping(&pObj1, &pObj2, pGame->pQt);
+        if (pGrid) {
+            rv = grid_getOverlaping(&pObj1, &pObj2, pGrid);
+        }
+        else {
+            rv = gfmQuadtree_getOverlaping(&pObj1, &pObj2, pGame->pQt);
+        }
         ASSERT(rv == GFMRV_OK, rv);
         
-        rv = gfmObject_getChild((void**)&pSpr1, &type1, pObj1);
-        ASSERT(rv == GFMRV_OK, rv);
-        rv = gfmObject_getChild((void**)&pSpr2, &type2, pObj2);
+        rv = collide_pushPair(pObj1, pObj2);
         ASSERT(rv == GFMRV_OK, rv);
         
-        if (type1 == gfmType_sprite) {
-            rv = gfmSprite_getChild((void**)&pMob1, &type1, pSpr1);
-            ASSERT(rv == GFMRV_OK, rv);
-        }
-        if (type2 == gfmType_sprite) {
-            rv = gfmSprite_getChild((void**)&pMob2, &type2, pSpr2);
-            ASSERT(rv == GFMRV_OK, rv);
-        }
-        
-        if (type1 == win && type2 == player) {
-            if (pGame->state == state_playstate) {
-                rv = playstate_setWin(pGame);
-            }
-        }
-        else if (type2 == win && type1 == player) {
-            if (pGame->state == state_playstate) {
-                rv = playstate_setWin(pGame);
-            }
-        }
-        else if ((type1 == wall || type1 == collideable) &&
-                (type2 == player || type2 == shadow)) {
-            rv = collide_mobXWall(pObj2, pObj1);
-        }
-        else if ((type2 == wall || type2 == collideable) &&
-                (type1 == player || type1 == shadow)) {
-            rv = collide_mobXWall(pObj1, pObj2);
-        }
-        else if (type1 == scan && (type2 == player || type2 == shadow)) {
-            rv = collide_scanXMob(pObj1, pMob2);
-        }
-        else if (type2 == scan && (type1 == player || type1 == shadow)) {
-            rv = collide_scanXMob(pObj2, pMob1);
-        }
-        else if (type1 == atk && (type2 == player || type2 == shadow ||
-                type2 == wall)) {
-            rv = collide_atkXMob(pObj1, pMob2, pGame);
-        }
-        else if (type2 == atk && (type1 == player || type1 == shadow ||
-                type1 == wall)) {
-            rv = collide_atkXMob(pObj2, pMob1, pGame);
+        if (pGrid) {
+            rv = grid_continue(pGrid);
         }
         else {
-            // Collision between mob's hitboxes, do nothing!
+            rv = gfmQuadtree_continue(pGame->pQt);
         }
-        ASSERT(rv == GFMRV_OK, rv);
-        
-        rv = gfmQuadtree_continue(pGame->pQt);
         ASSERT(rv == GFMRV_QUADTREE_OVERLAPED || rv == GFMRV_QUADTREE_DONE,
                 rv);
     }
@@ -151,15 +388,19 @@ __ret:
     return rv;
 }
 
-gfmRV collide_obj(gfmObject *pObj, gameCtx *pGame) {
+/**
+ * Check an object against the static layer (i.e., the world and the walls)
+ */
+static gfmRV collide_static(gfmObject *pObj, int category, int mask,
+        gameCtx *pGame) {
     gfmRV rv;
     
-    rv = gfmQuadtree_collideObject(pGame->pQt, pObj);
+    rv = grid_queryObject(pGame->pStatic, pObj, category, mask);
     ASSERT(rv == GFMRV_QUADTREE_OVERLAPED || rv == GFMRV_QUADTREE_DONE,
             rv);
     
     if (rv == GFMRV_QUADTREE_OVERLAPED) {
-        rv = doCollide(pGame);
+        rv = doCollide(pGame, pGame->pStatic);
         ASSERT(rv == GFMRV_OK, rv);
     }
     
@@ -168,15 +409,296 @@ __ret:
     return rv;
 }
 
-gfmRV collide_spr(gfmSprite *pSpr, gameCtx *pGame) {
+/**
+ * Clear the broadphase used by moving objects; Must be called before anything
+ * is collided on a frame. Changing pGame->broadphase only takes effect here
+ * 
+ * @param  pGame  The game's context
+ * @param  x      Horizontal position of the simulated area
+ * @param  width  Width of the simulated area (i.e., the loaded chunks)
+ * @param  height The world's height
+ */
+gfmRV collide_initFrame(gameCtx *pGame, int x, int width, int height) {
+    gfmRV rv;
+    
+    switch (pGame->broadphase) {
+        case broadphase_quadtree: {
+            rv = gfmQuadtree_initRoot(pGame->pQt, x, 0/*y*/, width, height,
+                    6/*maxDepth*/, 10/*maxNodes*/);
+        } break;
+        case broadphase_grid: {
+            // Sized to the sprites' 32x32 cells
+            rv = grid_init(pGame->pGrid, x, 0/*y*/, width, height,
+                    32/*cellWidth*/, 32/*cellHeight*/);
+        } break;
+        default: rv = GFMRV_INTERNAL_ERROR;
+    }
+    
+    return rv;
+}
+
+/**
+ * Prepare the static layer for a new world; Everything that never moves should
+ * be added to it once, instead of being re-inserted on the quadtree every frame
+ * 
+ * @param  pGame  The game's context
+ * @param  width  The world's width
+ * @param  height The world's height
+ */
+gfmRV collide_initStatic(gameCtx *pGame, int width, int height) {
+    return grid_init(pGame->pStatic, 0/*x*/, 0/*y*/, width, height,
+            32/*cellWidth*/, 32/*cellHeight*/);
+}
+
+gfmRV collide_addStaticObj(gfmObject *pObj, gameCtx *pGame) {
+    gfmRV rv;
+    int category, mask;
+    
+    rv = collide_getFilter(&category, &mask, pObj);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = grid_populateObject(pGame->pStatic, pObj, category, mask);
+__ret:
+    return rv;
+}
+
+gfmRV collide_addStaticSpr(gfmSprite *pSpr, gameCtx *pGame) {
+    gfmObject *pObj;
+    gfmRV rv;
+    
+    rv = gfmSprite_getObject(&pObj, pSpr);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = collide_addStaticObj(pObj, pGame);
+__ret:
+    return rv;
+}
+
+/**
+ * Remove a sprite from the static layer (e.g., a destroyed wall)
+ */
+gfmRV collide_removeStaticSpr(gfmSprite *pSpr, gameCtx *pGame) {
+    gfmObject *pObj;
+    gfmRV rv;
+    
+    rv = gfmSprite_getObject(&pObj, pSpr);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = grid_removeObject(pGame->pStatic, pObj);
+__ret:
+    return rv;
+}
+
+/**
+ * Clear the view layer, which keeps every mob's position on the start of the
+ * frame, so mobs may look for each other without colliding anything
+ */
+gfmRV collide_initView(gameCtx *pGame, int x, int width, int height) {
+    return grid_init(pGame->pView, x, 0/*y*/, width, height,
+            32/*cellWidth*/, 32/*cellHeight*/);
+}
+
+gfmRV collide_addViewSpr(gfmSprite *pSpr, gameCtx *pGame) {
+    gfmObject *pObj;
+    gfmRV rv;
+    int category, mask;
+    
+    rv = gfmSprite_getObject(&pObj, pSpr);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = collide_getFilter(&category, &mask, pObj);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Anything may look for any mob
+    rv = grid_populateObject(pGame->pView, pObj, category, ~0/*mask*/);
+__ret:
+    return rv;
+}
+
+/**
+ * Retrieve every mob within a rectangle; The list is only valid until the next
+ * query
+ * 
+ * @param  pppMobs The mobs found
+ * @param  pNum    How many mobs were found
+ * @param  pGame   The game's context
+ * @param  x       Rectangle's horizontal position
+ * @param  y       Rectangle's vertical position
+ * @param  width   Rectangle's width
+ * @param  height  Rectangle's height
+ */
+gfmRV collide_queryView(mob ***pppMobs, int *pNum, gameCtx *pGame, int x,
+        int y, int width, int height) {
+    gfmObject **ppObjs;
+    gfmRV rv;
+    int i, num;
+    
+    rv = grid_queryRect(&ppObjs, &num, pGame->pView, x, y, width, height,
+            ~0/*mask*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Convert the list in place (there's exactly one mob per object)
+    i = 0;
+    while (i < num) {
+        gfmSprite *pSpr;
+        int type;
+        
+        rv = gfmObject_getChild((void**)&pSpr, &type, ppObjs[i]);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = gfmSprite_getChild(((void**)ppObjs) + i, &type, pSpr);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        i++;
+    }
+    
+    *pppMobs = (mob**)ppObjs;
+    *pNum = num;
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+gfmRV collide_obj(gfmObject *pObj, gameCtx *pGame) {
     gfmRV rv;
+    int category, mask;
+    
+    rv = collide_getFilter(&category, &mask, pObj);
+    ASSERT(rv == GFMRV_OK, rv);
     
-    rv = gfmQuadtree_collideSprite(pGame->pQt, pSpr);
+    rv = collide_static(pObj, category, mask, pGame);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    if (pGame->broadphase == broadphase_grid) {
+        rv = grid_collideObject(pGame->pGrid, pObj, category, mask);
+    }
+    else {
+        // The quadtree can't filter anything, so pairs without a response are
+        // only discarded by collide_testPair
+        rv = gfmQuadtree_collideObject(pGame->pQt, pObj);
+    }
     ASSERT(rv == GFMRV_QUADTREE_OVERLAPED || rv == GFMRV_QUADTREE_DONE,
             rv);
     
     if (rv == GFMRV_QUADTREE_OVERLAPED) {
-        rv = doCollide(pGame);
+        if (pGame->broadphase == broadphase_grid) {
+            rv = doCollide(pGame, pGame->pGrid);
+        }
+        else {
+            rv = doCollide(pGame, 0/*pGrid*/);
+        }
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+gfmRV collide_spr(gfmSprite *pSpr, gameCtx *pGame) {
+    gfmObject *pObj;
+    gfmRV rv;
+    
+    rv = gfmSprite_getObject(&pObj, pSpr);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = collide_obj(pObj, pGame);
+__ret:
+    return rv;
+}
+
+/**
+ * Solve every pair found since the last flush; The pairs are tested in
+ * parallel and their responses are then applied, sorted, on this thread:
+ * every push out of walls is merged per object (the largest push on each
+ * direction), every hit is recorded on its victim and then resolved once per
+ * victim (with the strongest hit) and the level is won if the player reached
+ * the goal
+ */
+gfmRV collide_flush(gameCtx *pGame) {
+    gfmRV rv;
+    int didWin, i;
+    
+    rv = jobs_parallelFor(pGame->pJobs, collide_testRange, 0/*pCtx*/,
+            numPairs, PAIR_GRAIN);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    qsort(pPairs, numPairs, sizeof(collidePair), collide_cmpPairs);
+    
+    didWin = 0;
+    i = 0;
+    while (i < numPairs) {
+        collidePair *pPair;
+        
+        pPair = pPairs + i;
+        switch (pPair->resp) {
+            case resp_push: {
+                int maxX, maxY, minX, minY, x, y;
+                void *pTarget;
+                
+                // Merge every push on the same object
+                pTarget = pPair->pTarget;
+                maxX = 0;
+                maxY = 0;
+                minX = 0;
+                minY = 0;
+                while (i < numPairs && pPairs[i].resp == resp_push &&
+                        pPairs[i].pTarget == pTarget) {
+                    if (pPairs[i].dx > maxX) maxX = pPairs[i].dx;
+                    if (pPairs[i].dx < minX) minX = pPairs[i].dx;
+                    if (pPairs[i].dy > maxY) maxY = pPairs[i].dy;
+                    if (pPairs[i].dy < minY) minY = pPairs[i].dy;
+                    i++;
+                }
+                
+                rv = gfmObject_getPosition(&x, &y, (gfmObject*)pTarget);
+                ASSERT(rv == GFMRV_OK, rv);
+                rv = gfmObject_setPosition((gfmObject*)pTarget,
+                        x + maxX + minX, y + maxY + minY);
+                ASSERT(rv == GFMRV_OK, rv);
+                
+                // i already points to the next response
+                continue;
+            } break;
+            case resp_attack: {
+                // Only record the hit; Every victim is resolved once, later
+                rv = mob_addHit(pPair->pSource, (mob*)pPair->pTarget);
+                ASSERT(rv == GFMRV_TRUE || rv == GFMRV_FALSE, rv);
+                
+                if (rv == GFMRV_TRUE) {
+                    if (numVictims >= victimsLen) {
+                        mob **ppTmp;
+                        
+                        ppTmp = (mob**)realloc(ppVictims, sizeof(mob*) *
+                                (victimsLen * 2 + 16));
+                        ASSERT(ppTmp, GFMRV_ALLOC_FAILED);
+                        ppVictims = ppTmp;
+                        victimsLen = victimsLen * 2 + 16;
+                    }
+                    ppVictims[numVictims] = (mob*)pPair->pTarget;
+                    numVictims++;
+                }
+            } break;
+            case resp_win: {
+                didWin = 1;
+            } break;
+            default: {}
+        }
+        
+        i++;
+    }
+    numPairs = 0;
+    
+    // Resolve the damage buffer: one attack per victim
+    i = 0;
+    while (i < numVictims) {
+        rv = mob_resolveHits(ppVictims[i], pGame);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        i++;
+    }
+    numVictims = 0;
+    
+    if (didWin && pGame->state == state_playstate) {
+        rv = playstate_setWin(pGame);
         ASSERT(rv == GFMRV_OK, rv);
     }
     
@@ -185,3 +707,19 @@ __ret:
     return rv;
 }
 
+/**
+ * Release the memory used by the pair list
+ */
+gfmRV collide_free() {
+    free(pPairs);
+    pPairs = 0;
+    pairsLen = 0;
+    numPairs = 0;
+    free(ppVictims);
+    ppVictims = 0;
+    victimsLen = 0;
+    numVictims = 0;
+    
+    return GFMRV_OK;
+}
+
@@ -0,0 +1,313 @@
+/**
+ * @file src/flowfield.c
+ *
+ * Flowfield calculated by a breadth-first search from the target's cell; Each
+ * mob then only has to check its cell's neighbours to find its way
+ */
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+
+#include <ld33/flowfield.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+struct stFlowfield {
+    /** Every cell's distance (in cells) to the target (-1, if unreachable) */
+    int *pDist;
+    /** Whether each cell is impassable */
+    char *pBlocked;
+    /** Cells yet to be visited by the search */
+    int *pQueue;
+    /** How many cells were alloc'ed */
+    int cellsLen;
+    /** Field's position and dimensions */
+    int x;
+    int y;
+    int width;
+    int height;
+    int cellSize;
+    int columns;
+    int rows;
+    /** Cell where the target was on the last update (-1, if none) */
+    int targetCell;
+    /** Whether the distances must be recalculated (e.g., a cell was blocked) */
+    int isDirty;
+};
+
+/**
+ * Get the cell at a position
+ *
+ * @return The cell's index or -1, if outside the field
+ */
+static int flowfield_getCell(flowfield *pField, int x, int y) {
+    x -= pField->x;
+    y -= pField->y;
+    if (x < 0 || y < 0 || x >= pField->width || y >= pField->height) {
+        return -1;
+    }
+    
+    return x / pField->cellSize + (y / pField->cellSize) * pField->columns;
+}
+
+/**
+ * Alloc a new flowfield
+ */
+gfmRV flowfield_getNew(flowfield **ppField) {
+    gfmRV rv;
+    
+    ASSERT(ppField, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppField), GFMRV_ARGUMENTS_BAD);
+    
+    *ppField = (flowfield*)malloc(sizeof(flowfield));
+    ASSERT(*ppField, GFMRV_ALLOC_FAILED);
+    
+    memset(*ppField, 0x0, sizeof(flowfield));
+    (*ppField)->targetCell = -1;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Free a flowfield's memory
+ */
+gfmRV flowfield_free(flowfield **ppField) {
+    gfmRV rv;
+    
+    ASSERT(ppField, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppField, GFMRV_ARGUMENTS_BAD);
+    
+    free((*ppField)->pDist);
+    free((*ppField)->pBlocked);
+    free((*ppField)->pQueue);
+    free(*ppField);
+    *ppField = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * (Re)Initialize the field's dimensions and remove every obstacle from it;
+ * Previously alloc'ed memory is reused, if possible
+ */
+gfmRV flowfield_init(flowfield *pField, int x, int y, int width, int height,
+        int cellSize) {
+    gfmRV rv;
+    int num;
+    
+    ASSERT(pField, GFMRV_ARGUMENTS_BAD);
+    ASSERT(width > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(height > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(cellSize > 0, GFMRV_ARGUMENTS_BAD);
+    
+    pField->x = x;
+    pField->y = y;
+    pField->width = width;
+    pField->height = height;
+    pField->cellSize = cellSize;
+    pField->columns = (width + cellSize - 1) / cellSize;
+    pField->rows = (height + cellSize - 1) / cellSize;
+    
+    num = pField->columns * pField->rows;
+    if (num > pField->cellsLen) {
+        char *pTmpBlocked;
+        int *pTmp;
+        
+        pTmp = (int*)realloc(pField->pDist, sizeof(int) * num);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pField->pDist = pTmp;
+        pTmp = (int*)realloc(pField->pQueue, sizeof(int) * num);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pField->pQueue = pTmp;
+        pTmpBlocked = (char*)realloc(pField->pBlocked, sizeof(char) * num);
+        ASSERT(pTmpBlocked, GFMRV_ALLOC_FAILED);
+        pField->pBlocked = pTmpBlocked;
+        pField->cellsLen = num;
+    }
+    
+    memset(pField->pBlocked, 0x0, sizeof(char) * num);
+    // -1 on every byte is -1 on every int
+    memset(pField->pDist, 0xff, sizeof(int) * num);
+    pField->targetCell = -1;
+    pField->isDirty = 1;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Mark every cell touched by a rectangle as impassable
+ */
+gfmRV flowfield_block(flowfield *pField, int x, int y, int width, int height) {
+    gfmRV rv;
+    int cx, cy, firstX, lastX, lastY;
+    
+    ASSERT(pField, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pField->pBlocked, GFMRV_ARGUMENTS_BAD);
+    
+    x -= pField->x;
+    y -= pField->y;
+
+#define CLAMP(val, max) \
+        if (val < 0) val = 0; \
+        else if (val >= max) val = max - 1
+    // Ignore anything outside the field
+    if (x + width <= 0 || y + height <= 0 || x >= pField->width ||
+            y >= pField->height) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    firstX = x / pField->cellSize;
+    CLAMP(firstX, pField->columns);
+    cy = y / pField->cellSize;
+    CLAMP(cy, pField->rows);
+    lastX = (x + width - 1) / pField->cellSize;
+    CLAMP(lastX, pField->columns);
+    lastY = (y + height - 1) / pField->cellSize;
+    CLAMP(lastY, pField->rows);
+#undef CLAMP
+
+    while (cy <= lastY) {
+        cx = firstX;
+        while (cx <= lastX) {
+            pField->pBlocked[cx + cy * pField->columns] = 1;
+            cx++;
+        }
+        cy++;
+    }
+    pField->isDirty = 1;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Set the position everything flows to; The distances are only recalculated
+ * if it's on a different cell (or if an obstacle was added)
+ */
+gfmRV flowfield_update(flowfield *pField, int x, int y) {
+    gfmRV rv;
+    int cell, first, last;
+    
+    ASSERT(pField, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pField->pDist, GFMRV_ARGUMENTS_BAD);
+    
+    cell = flowfield_getCell(pField, x, y);
+    if (!pField->isDirty && cell == pField->targetCell) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    pField->targetCell = cell;
+    pField->isDirty = 0;
+    
+    memset(pField->pDist, 0xff, sizeof(int) * pField->columns * pField->rows);
+    if (cell == -1) {
+        // Nothing can reach a target outside the field
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    // Breadth-first search from the target, so each cell gets its distance
+    // the first time it's visited
+    pField->pDist[cell] = 0;
+    pField->pQueue[0] = cell;
+    first = 0;
+    last = 1;
+    while (first < last) {
+        int cx, cy, dist;
+        
+        cell = pField->pQueue[first];
+        first++;
+        
+        cx = cell % pField->columns;
+        cy = cell / pField->columns;
+        dist = pField->pDist[cell] + 1;
+
+#define VISIT(next) \
+        do { \
+            if (!pField->pBlocked[next] && pField->pDist[next] == -1) { \
+                pField->pDist[next] = dist; \
+                pField->pQueue[last] = next; \
+                last++; \
+            } \
+        } while (0)
+        if (cx > 0) VISIT(cell - 1);
+        if (cx < pField->columns - 1) VISIT(cell + 1);
+        if (cy > 0) VISIT(cell - pField->columns);
+        if (cy < pField->rows - 1) VISIT(cell + pField->columns);
+#undef VISIT
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Get which way to go from a position; Both directions are 0 if the position
+ * can't reach the target (or is already on its cell)
+ */
+gfmRV flowfield_getDirection(int *pDirX, int *pDirY, flowfield *pField, int x,
+        int y, int isFleeing) {
+    /** Neighbours, orthogonal first (so they are preferred on ties) */
+    static const int pOffX[] = { -1, 1,  0, 0, -1,  1, -1, 1 };
+    static const int pOffY[] = {  0, 0, -1, 1, -1, -1,  1, 1 };
+    gfmRV rv;
+    int best, cell, cx, cy, i;
+    
+    ASSERT(pDirX, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pDirY, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pField, GFMRV_ARGUMENTS_BAD);
+    
+    *pDirX = 0;
+    *pDirY = 0;
+    
+    cell = flowfield_getCell(pField, x, y);
+    if (cell == -1 || pField->pDist[cell] == -1) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    cx = cell % pField->columns;
+    cy = cell / pField->columns;
+    best = pField->pDist[cell];
+    
+    i = 0;
+    while (i < 8) {
+        int dist, nx, ny;
+        
+        nx = cx + pOffX[i];
+        ny = cy + pOffY[i];
+        if (nx < 0 || ny < 0 || nx >= pField->columns || ny >= pField->rows) {
+            i++;
+            continue;
+        }
+        // Don't cut corners around obstacles
+        if (pOffX[i] != 0 && pOffY[i] != 0 &&
+                (pField->pBlocked[nx + cy * pField->columns] ||
+                pField->pBlocked[cx + ny * pField->columns])) {
+            i++;
+            continue;
+        }
+        
+        dist = pField->pDist[nx + ny * pField->columns];
+        if (dist != -1 && ((!isFleeing && dist < best) ||
+                (isFleeing && dist > best))) {
+            best = dist;
+            *pDirX = pOffX[i];
+            *pDirY = pOffY[i];
+        }
+        
+        i++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
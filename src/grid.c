@@ -0,0 +1,693 @@
+/**
+ * @file src/grid.c
+ *
+ * Uniform grid of fixed-size cells; Each cell keeps a linked list of the
+ * objects that touches it (stored on a single, reusable buffer). Removed
+ * objects are unlinked from their cells and their slots/nodes are kept on free
+ * lists, so a grid that lives through many adds and removes doesn't grow
+ */
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmObject.h>
+#include <GFraMe/gfmSprite.h>
+
+#include <ld33/grid.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** An object on the grid (and its cached bounds) */
+struct stGridObj {
+    gfmObject *pObj;
+    /** Bits that identify the object */
+    int category;
+    /** Categories that the object may overlap */
+    int mask;
+    int x;
+    int y;
+    int width;
+    int height;
+    /** First cell touched by the object */
+    int cellX;
+    int cellY;
+    /** Last cell touched by the object */
+    int lastCellX;
+    int lastCellY;
+    /** Next free slot (only used while the slot is free) */
+    int nextFree;
+};
+typedef struct stGridObj gridObj;
+
+/** Entry on a cell's list */
+struct stGridNode {
+    /** Index of the object */
+    int obj;
+    /** Index of the next node on the cell (or on the free list) (-1, if
+     * none) */
+    int next;
+};
+typedef struct stGridNode gridNode;
+
+struct stGrid {
+    /** First node of every cell (-1, if none) */
+    int *pCells;
+    /** How many cells were alloc'ed */
+    int cellsLen;
+    /** Every node on the grid */
+    gridNode *pNodes;
+    int nodesLen;
+    int nodesUsed;
+    /** First node released by a removed object (-1, if none) */
+    int freeNode;
+    /** Every object on the grid */
+    gridObj *pObjs;
+    int objsLen;
+    int objsUsed;
+    /** First slot released by a removed object (-1, if none) */
+    int freeObj;
+    /** Grid's position and dimensions */
+    int x;
+    int y;
+    int width;
+    int height;
+    int cellWidth;
+    int cellHeight;
+    int columns;
+    int rows;
+    /** Object being checked, and its bounds */
+    gridObj query;
+    /** Cell and node being checked */
+    int curCellX;
+    int curCellY;
+    int curNode;
+    /** Object overlaping the query */
+    gfmObject *pOther;
+    /** Objects found by the last rectangle query */
+    gfmObject **ppResults;
+    int resultsLen;
+};
+
+/**
+ * Calculate the cells touched by an already positioned object
+ *
+ * @return GFMRV_TRUE (if on the grid), GFMRV_FALSE
+ */
+static gfmRV grid_getCells(gridObj *pGObj, grid *pGrid) {
+    int x, y;
+    
+    // Ignore anything outside the grid (plus a cell, for the world's bounds)
+    x = pGObj->x - pGrid->x;
+    y = pGObj->y - pGrid->y;
+    if (x + pGObj->width < -pGrid->cellWidth ||
+            x > pGrid->width + pGrid->cellWidth ||
+            y + pGObj->height < -pGrid->cellHeight ||
+            y > pGrid->height + pGrid->cellHeight) {
+        return GFMRV_FALSE;
+    }
+
+#define CLAMP(val, max) \
+        if (val < 0) val = 0; \
+        else if (val >= max) val = max - 1
+    pGObj->cellX = x / pGrid->cellWidth;
+    CLAMP(pGObj->cellX, pGrid->columns);
+    pGObj->cellY = y / pGrid->cellHeight;
+    CLAMP(pGObj->cellY, pGrid->rows);
+    pGObj->lastCellX = (x + pGObj->width) / pGrid->cellWidth;
+    CLAMP(pGObj->lastCellX, pGrid->columns);
+    pGObj->lastCellY = (y + pGObj->height) / pGrid->cellHeight;
+    CLAMP(pGObj->lastCellY, pGrid->rows);
+#undef CLAMP
+
+    return GFMRV_TRUE;
+}
+
+/**
+ * Calculate the object's bounds and the cells touched by it
+ *
+ * @return GFMRV_TRUE (if on the grid), GFMRV_FALSE, ...
+ */
+static gfmRV grid_getBounds(gridObj *pGObj, grid *pGrid, gfmObject *pObj,
+        int category, int mask) {
+    gfmRV rv;
+    
+    pGObj->pObj = pObj;
+    pGObj->category = category;
+    pGObj->mask = mask;
+    rv = gfmObject_getPosition(&(pGObj->x), &(pGObj->y), pObj);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmObject_getDimensions(&(pGObj->width), &(pGObj->height), pObj);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = grid_getCells(pGObj, pGrid);
+__ret:
+    return rv;
+}
+
+/**
+ * Check if two objects may interact, if they overlap and if this is the first
+ * cell they share (so each pair is reported only once)
+ */
+static int grid_isNewOverlap(gridObj *pA, gridObj *pB, int cellX, int cellY) {
+    int firstX, firstY;
+    
+    if (!(pA->category & pB->mask) || !(pB->category & pA->mask)) {
+        return 0;
+    }
+    if (pA->x >= pB->x + pB->width || pB->x >= pA->x + pA->width ||
+            pA->y >= pB->y + pB->height || pB->y >= pA->y + pA->height) {
+        return 0;
+    }
+    
+    firstX = (pA->cellX > pB->cellX) ? pA->cellX : pB->cellX;
+    firstY = (pA->cellY > pB->cellY) ? pA->cellY : pB->cellY;
+    
+    return cellX == firstX && cellY == firstY;
+}
+
+/**
+ * Look for the next object overlaping the query, starting from the current
+ * node/cell
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE
+ */
+static gfmRV grid_findNext(grid *pGrid) {
+    gridObj *pQuery;
+    
+    pQuery = &(pGrid->query);
+    while (pGrid->curCellY <= pQuery->lastCellY) {
+        while (pGrid->curNode != -1) {
+            gridNode *pNode;
+            gridObj *pOther;
+            
+            pNode = pGrid->pNodes + pGrid->curNode;
+            pOther = pGrid->pObjs + pNode->obj;
+            pGrid->curNode = pNode->next;
+            
+            if (pOther->pObj != pQuery->pObj &&
+                    grid_isNewOverlap(pQuery, pOther, pGrid->curCellX,
+                    pGrid->curCellY)) {
+                pGrid->pOther = pOther->pObj;
+                return GFMRV_QUADTREE_OVERLAPED;
+            }
+        }
+        
+        // Go to the next cell
+        pGrid->curCellX++;
+        if (pGrid->curCellX > pQuery->lastCellX) {
+            pGrid->curCellX = pQuery->cellX;
+            pGrid->curCellY++;
+        }
+        if (pGrid->curCellY <= pQuery->lastCellY) {
+            pGrid->curNode = pGrid->pCells[pGrid->curCellX +
+                    pGrid->curCellY * pGrid->columns];
+        }
+    }
+    
+    pGrid->pOther = 0;
+    return GFMRV_QUADTREE_DONE;
+}
+
+/**
+ * Retrieve an unused node, either a released one or a new one from the end of
+ * the buffer (which is expanded, if needed)
+ */
+static gfmRV grid_getNode(int *pNode, grid *pGrid) {
+    gfmRV rv;
+    
+    if (pGrid->freeNode != -1) {
+        *pNode = pGrid->freeNode;
+        pGrid->freeNode = pGrid->pNodes[*pNode].next;
+        
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    if (pGrid->nodesUsed >= pGrid->nodesLen) {
+        gridNode *pTmp;
+        int num;
+        
+        num = pGrid->nodesLen * 2 + 16;
+        pTmp = (gridNode*)realloc(pGrid->pNodes, sizeof(gridNode) * num);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pGrid->pNodes = pTmp;
+        pGrid->nodesLen = num;
+    }
+    *pNode = pGrid->nodesUsed;
+    pGrid->nodesUsed++;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Retrieve an unused object slot, either a released one or a new one from the
+ * end of the buffer (which is expanded, if needed)
+ */
+static gfmRV grid_getObj(int *pObj, grid *pGrid) {
+    gfmRV rv;
+    
+    if (pGrid->freeObj != -1) {
+        *pObj = pGrid->freeObj;
+        pGrid->freeObj = pGrid->pObjs[*pObj].nextFree;
+        
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    if (pGrid->objsUsed >= pGrid->objsLen) {
+        gridObj *pTmp;
+        int num;
+        
+        num = pGrid->objsLen * 2 + 16;
+        pTmp = (gridObj*)realloc(pGrid->pObjs, sizeof(gridObj) * num);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pGrid->pObjs = pTmp;
+        pGrid->objsLen = num;
+    }
+    *pObj = pGrid->objsUsed;
+    pGrid->objsUsed++;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Alloc a new grid
+ */
+gfmRV grid_getNew(grid **ppGrid) {
+    gfmRV rv;
+    
+    ASSERT(ppGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppGrid), GFMRV_ARGUMENTS_BAD);
+    
+    *ppGrid = (grid*)malloc(sizeof(grid));
+    ASSERT(*ppGrid, GFMRV_ALLOC_FAILED);
+    
+    memset(*ppGrid, 0x0, sizeof(grid));
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Free a grid's memory
+ */
+gfmRV grid_free(grid **ppGrid) {
+    gfmRV rv;
+    
+    ASSERT(ppGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppGrid, GFMRV_ARGUMENTS_BAD);
+    
+    free((*ppGrid)->pCells);
+    free((*ppGrid)->pNodes);
+    free((*ppGrid)->pObjs);
+    free((*ppGrid)->ppResults);
+    free(*ppGrid);
+    *ppGrid = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * (Re)Initialize the grid's dimensions and remove every object from it;
+ * Previously alloc'ed memory is reused, if possible
+ */
+gfmRV grid_init(grid *pGrid, int x, int y, int width, int height,
+        int cellWidth, int cellHeight) {
+    gfmRV rv;
+    int num;
+    
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(width > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(height > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(cellWidth > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(cellHeight > 0, GFMRV_ARGUMENTS_BAD);
+    
+    pGrid->x = x;
+    pGrid->y = y;
+    pGrid->width = width;
+    pGrid->height = height;
+    pGrid->cellWidth = cellWidth;
+    pGrid->cellHeight = cellHeight;
+    pGrid->columns = (width + cellWidth - 1) / cellWidth;
+    pGrid->rows = (height + cellHeight - 1) / cellHeight;
+    
+    num = pGrid->columns * pGrid->rows;
+    if (num > pGrid->cellsLen) {
+        int *pTmp;
+        
+        pTmp = (int*)realloc(pGrid->pCells, sizeof(int) * num);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pGrid->pCells = pTmp;
+        pGrid->cellsLen = num;
+    }
+    
+    rv = grid_reset(pGrid);
+__ret:
+    return rv;
+}
+
+/**
+ * Remove every object from the grid (but keep its dimensions and memory)
+ */
+gfmRV grid_reset(grid *pGrid) {
+    gfmRV rv;
+    
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pGrid->pCells, GFMRV_ARGUMENTS_BAD);
+    
+    // -1 on every byte is -1 on every int
+    memset(pGrid->pCells, 0xff, sizeof(int) * pGrid->columns * pGrid->rows);
+    pGrid->nodesUsed = 0;
+    pGrid->freeNode = -1;
+    pGrid->objsUsed = 0;
+    pGrid->freeObj = -1;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Add an object to the grid, without checking for overlaps; Objects completely
+ * outside the grid (with a cell of tolerance) are ignored
+ */
+gfmRV grid_populateObject(grid *pGrid, gfmObject *pObj, int category,
+        int mask) {
+    gfmRV rv;
+    gridObj gObj;
+    int cellX, cellY, obj;
+    
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pObj, GFMRV_ARGUMENTS_BAD);
+    
+    rv = grid_getBounds(&gObj, pGrid, pObj, category, mask);
+    ASSERT(rv == GFMRV_TRUE || rv == GFMRV_FALSE, rv);
+    if (rv == GFMRV_FALSE) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    rv = grid_getObj(&obj, pGrid);
+    ASSERT(rv == GFMRV_OK, rv);
+    gObj.nextFree = -1;
+    pGrid->pObjs[obj] = gObj;
+    
+    // Add it to every cell it touches
+    cellY = gObj.cellY;
+    while (cellY <= gObj.lastCellY) {
+        cellX = gObj.cellX;
+        while (cellX <= gObj.lastCellX) {
+            int *pCell;
+            int node;
+            
+            rv = grid_getNode(&node, pGrid);
+            ASSERT(rv == GFMRV_OK, rv);
+            pCell = pGrid->pCells + cellX + cellY * pGrid->columns;
+            
+            pGrid->pNodes[node].obj = obj;
+            pGrid->pNodes[node].next = *pCell;
+            *pCell = node;
+            
+            cellX++;
+        }
+        cellY++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Add a sprite to the grid, without checking for overlaps
+ */
+gfmRV grid_populateSprite(grid *pGrid, gfmSprite *pSpr, int category,
+        int mask) {
+    gfmObject *pObj;
+    gfmRV rv;
+    
+    rv = gfmSprite_getObject(&pObj, pSpr);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = grid_populateObject(pGrid, pObj, category, mask);
+__ret:
+    return rv;
+}
+
+/**
+ * Remove an object from the grid (e.g., a wall that was destroyed); It must
+ * still be where it was when it was added, since it's only looked for on the
+ * first cell it touches. Its nodes and slot are reused by the next objects
+ */
+gfmRV grid_removeObject(grid *pGrid, gfmObject *pObj) {
+    gfmRV rv;
+    gridObj gObj, *pGObj;
+    int cellX, cellY, node, obj;
+    
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pObj, GFMRV_ARGUMENTS_BAD);
+    
+    rv = grid_getBounds(&gObj, pGrid, pObj, 0/*category*/, 0/*mask*/);
+    ASSERT(rv == GFMRV_TRUE || rv == GFMRV_FALSE, rv);
+    if (rv == GFMRV_FALSE) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    // Find its slot on the first cell it touches
+    obj = -1;
+    node = pGrid->pCells[gObj.cellX + gObj.cellY * pGrid->columns];
+    while (node != -1) {
+        if (pGrid->pObjs[pGrid->pNodes[node].obj].pObj == pObj) {
+            obj = pGrid->pNodes[node].obj;
+            break;
+        }
+        node = pGrid->pNodes[node].next;
+    }
+    if (obj == -1) {
+        // It isn't on the grid
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    pGObj = pGrid->pObjs + obj;
+    
+    // Unlink it from every cell it touches (using the cells from when it was
+    // added) and release its nodes
+    cellY = pGObj->cellY;
+    while (cellY <= pGObj->lastCellY) {
+        cellX = pGObj->cellX;
+        while (cellX <= pGObj->lastCellX) {
+            int *pPrev;
+            
+            pPrev = pGrid->pCells + cellX + cellY * pGrid->columns;
+            while (*pPrev != -1) {
+                node = *pPrev;
+                if (pGrid->pNodes[node].obj == obj) {
+                    *pPrev = pGrid->pNodes[node].next;
+                    pGrid->pNodes[node].next = pGrid->freeNode;
+                    pGrid->freeNode = node;
+                    break;
+                }
+                pPrev = &(pGrid->pNodes[node].next);
+            }
+            
+            cellX++;
+        }
+        cellY++;
+    }
+    
+    pGObj->pObj = 0;
+    pGObj->nextFree = pGrid->freeObj;
+    pGrid->freeObj = obj;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Check an object against everything on the grid, without adding it
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_queryObject(grid *pGrid, gfmObject *pObj, int category, int mask) {
+    gfmRV rv;
+    
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pObj, GFMRV_ARGUMENTS_BAD);
+    
+    rv = grid_getBounds(&(pGrid->query), pGrid, pObj, category, mask);
+    ASSERT(rv == GFMRV_TRUE || rv == GFMRV_FALSE, rv);
+    if (rv == GFMRV_FALSE) {
+        pGrid->pOther = 0;
+        rv = GFMRV_QUADTREE_DONE;
+        goto __ret;
+    }
+    
+    pGrid->curCellX = pGrid->query.cellX;
+    pGrid->curCellY = pGrid->query.cellY;
+    pGrid->curNode = pGrid->pCells[pGrid->curCellX +
+            pGrid->curCellY * pGrid->columns];
+    
+    rv = grid_findNext(pGrid);
+__ret:
+    return rv;
+}
+
+/**
+ * Add an object to the grid and check it against everything that was already
+ * on it (same as gfmQuadtree_collideObject)
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_collideObject(grid *pGrid, gfmObject *pObj, int category,
+        int mask) {
+    gfmRV rv;
+    
+    // Since nodes are prepended to the cells, the object is only ever checked
+    // against itself (which is skipped)
+    rv = grid_populateObject(pGrid, pObj, category, mask);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = grid_queryObject(pGrid, pObj, category, mask);
+__ret:
+    return rv;
+}
+
+/**
+ * Add a sprite to the grid and check it against everything on it
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_collideSprite(grid *pGrid, gfmSprite *pSpr, int category,
+        int mask) {
+    gfmObject *pObj;
+    gfmRV rv;
+    
+    rv = gfmSprite_getObject(&pObj, pSpr);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = grid_collideObject(pGrid, pObj, category, mask);
+__ret:
+    return rv;
+}
+
+/**
+ * Retrieve every object within a rectangle, without adding anything to the
+ * grid; The returned list is owned by the grid and is only valid until the
+ * next query
+ */
+gfmRV grid_queryRect(gfmObject ***pppObjs, int *pNum, grid *pGrid, int x,
+        int y, int width, int height, int mask) {
+    gfmRV rv;
+    gridObj rect;
+    int cellX, cellY, num;
+    
+    ASSERT(pppObjs, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pNum, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    
+    num = 0;
+    
+    rect.pObj = 0;
+    rect.category = ~0;
+    rect.mask = mask;
+    rect.x = x;
+    rect.y = y;
+    rect.width = width;
+    rect.height = height;
+    if (grid_getCells(&rect, pGrid) == GFMRV_FALSE) {
+        // Skip the loop below
+        rect.cellY = 0;
+        rect.lastCellY = -1;
+    }
+    
+    cellY = rect.cellY;
+    while (cellY <= rect.lastCellY) {
+        cellX = rect.cellX;
+        while (cellX <= rect.lastCellX) {
+            int node;
+            
+            node = pGrid->pCells[cellX + cellY * pGrid->columns];
+            while (node != -1) {
+                gridObj *pOther;
+                
+                pOther = pGrid->pObjs + pGrid->pNodes[node].obj;
+                node = pGrid->pNodes[node].next;
+                
+                if (!grid_isNewOverlap(&rect, pOther, cellX, cellY)) {
+                    continue;
+                }
+                
+                if (num >= pGrid->resultsLen) {
+                    gfmObject **ppTmp;
+                    int len;
+                    
+                    len = pGrid->resultsLen * 2 + 16;
+                    ppTmp = (gfmObject**)realloc(pGrid->ppResults,
+                            sizeof(gfmObject*) * len);
+                    ASSERT(ppTmp, GFMRV_ALLOC_FAILED);
+                    pGrid->ppResults = ppTmp;
+                    pGrid->resultsLen = len;
+                }
+                pGrid->ppResults[num] = pOther->pObj;
+                num++;
+            }
+            cellX++;
+        }
+        cellY++;
+    }
+    
+    *pppObjs = pGrid->ppResults;
+    *pNum = num;
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Retrieve the current overlaping pair; The first object is always the one
+ * that was being checked
+ */
+gfmRV grid_getOverlaping(gfmObject **ppObj1, gfmObject **ppObj2,
+        grid *pGrid) {
+    gfmRV rv;
+    
+    ASSERT(ppObj1, GFMRV_ARGUMENTS_BAD);
+    ASSERT(ppObj2, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pGrid->pOther, GFMRV_ARGUMENTS_BAD);
+    
+    *ppObj1 = pGrid->query.pObj;
+    *ppObj2 = pGrid->pOther;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Continue looking for overlaps
+ *
+ * @return GFMRV_QUADTREE_OVERLAPED, GFMRV_QUADTREE_DONE, ...
+ */
+gfmRV grid_continue(grid *pGrid) {
+    gfmRV rv;
+    
+    ASSERT(pGrid, GFMRV_ARGUMENTS_BAD);
+    
+    if (!pGrid->pOther) {
+        rv = GFMRV_QUADTREE_DONE;
+        goto __ret;
+    }
+    rv = grid_findNext(pGrid);
+__ret:
+    return rv;
+}
+
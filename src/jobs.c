@@ -0,0 +1,426 @@
+/**
+ * @file src/jobs.c
+ *
+ * Job system built on pthreads; Every thread owns a deque of ranges, protected
+ * by its own mutex: the owner pops from its bottom while thieves take from its
+ * top, so they rarely contend
+ */
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+
+#include <ld33/jobs.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(EMSCRIPT)
+#  include <pthread.h>
+#  define JOBS_USE_THREADS
+#endif
+#if !defined(EMSCRIPT) && !defined(_WIN32)
+#  include <unistd.h>
+#endif
+
+/** A range of a loop */
+struct stJobRange {
+    int first;
+    int last;
+};
+typedef struct stJobRange jobRange;
+
+#if defined(JOBS_USE_THREADS)
+/** Ranges owned by a thread; Valid ranges are those within [top, bottom) */
+struct stJobDeque {
+    pthread_mutex_t mutex;
+    jobRange *pRanges;
+    /** How many ranges fit on the deque */
+    int len;
+    /** Next range to be stolen */
+    int top;
+    /** Position after the owner's next range */
+    int bottom;
+};
+typedef struct stJobDeque jobDeque;
+
+/** Argument passed to each worker */
+struct stJobWorker {
+    jobSystem *pJobs;
+    /** Index of the worker's deque */
+    int index;
+};
+typedef struct stJobWorker jobWorker;
+#endif
+
+struct stJobSystem {
+#if defined(JOBS_USE_THREADS)
+    /** Every worker thread */
+    pthread_t *pThreads;
+    /** Arguments of every worker */
+    jobWorker *pWorkers;
+    /** One deque for each worker, plus one (the first) for the caller */
+    jobDeque *pDeques;
+    /** Protects everything below (except the loop's function and context,
+     * which are only written while no range is queued) */
+    pthread_mutex_t mutex;
+    /** Signaled whenever a loop starts (or the workers should quit) */
+    pthread_cond_t start;
+    /** Signaled when every range of the loop was run */
+    pthread_cond_t done;
+    /** Incremented every time a loop starts */
+    int generation;
+    /** How many ranges are yet to be finished */
+    int pending;
+    /** Whether the workers should quit */
+    int quit;
+    /** How many workers were actually started */
+    int numStarted;
+#endif
+    /** How many worker threads there are */
+    int numWorkers;
+    /** The loop being run */
+    jobFunc func;
+    void *pCtx;
+    /** First error returned by any range */
+    gfmRV rv;
+};
+
+#if defined(JOBS_USE_THREADS)
+/**
+ * Retrieve the next range from a thread's own deque or, if it's empty, steal
+ * one from any other deque
+ *
+ * @return 1 if a range was retrieved, 0 if every deque is empty
+ */
+static int jobs_getRange(jobRange *pRange, jobSystem *pJobs, int index) {
+    int i, numDeques;
+    jobDeque *pDeque;
+    
+    // Pop from the bottom of our own deque
+    pDeque = pJobs->pDeques + index;
+    pthread_mutex_lock(&(pDeque->mutex));
+    if (pDeque->bottom > pDeque->top) {
+        pDeque->bottom--;
+        *pRange = pDeque->pRanges[pDeque->bottom];
+        pthread_mutex_unlock(&(pDeque->mutex));
+        return 1;
+    }
+    pthread_mutex_unlock(&(pDeque->mutex));
+    
+    // Steal from the top of someone else's
+    numDeques = pJobs->numWorkers + 1;
+    i = 1;
+    while (i < numDeques) {
+        pDeque = pJobs->pDeques + (index + i) % numDeques;
+        
+        pthread_mutex_lock(&(pDeque->mutex));
+        if (pDeque->bottom > pDeque->top) {
+            *pRange = pDeque->pRanges[pDeque->top];
+            pDeque->top++;
+            pthread_mutex_unlock(&(pDeque->mutex));
+            return 1;
+        }
+        pthread_mutex_unlock(&(pDeque->mutex));
+        
+        i++;
+    }
+    
+    return 0;
+}
+
+/**
+ * Run ranges until every deque is empty
+ */
+static void jobs_work(jobSystem *pJobs, int index) {
+    jobRange range;
+    
+    while (jobs_getRange(&range, pJobs, index)) {
+        gfmRV rv;
+        
+        rv = pJobs->func(pJobs->pCtx, range.first, range.last);
+        
+        pthread_mutex_lock(&(pJobs->mutex));
+        if (rv != GFMRV_OK && pJobs->rv == GFMRV_OK) {
+            pJobs->rv = rv;
+        }
+        pJobs->pending--;
+        if (pJobs->pending == 0) {
+            pthread_cond_signal(&(pJobs->done));
+        }
+        pthread_mutex_unlock(&(pJobs->mutex));
+    }
+}
+
+/**
+ * Worker's main loop; Sleeps until a loop starts, helps running it and goes
+ * back to sleep
+ */
+static void* jobs_workerMain(void *pArg) {
+    jobSystem *pJobs;
+    jobWorker *pWorker;
+    int generation;
+    
+    pWorker = (jobWorker*)pArg;
+    pJobs = pWorker->pJobs;
+    
+    generation = 0;
+    while (1) {
+        pthread_mutex_lock(&(pJobs->mutex));
+        while (!pJobs->quit && generation == pJobs->generation) {
+            pthread_cond_wait(&(pJobs->start), &(pJobs->mutex));
+        }
+        if (pJobs->quit) {
+            pthread_mutex_unlock(&(pJobs->mutex));
+            break;
+        }
+        generation = pJobs->generation;
+        pthread_mutex_unlock(&(pJobs->mutex));
+        
+        jobs_work(pJobs, pWorker->index);
+    }
+    
+    return 0;
+}
+#endif /* JOBS_USE_THREADS */
+
+/**
+ * Alloc a new job system and start its workers
+ */
+gfmRV jobs_getNew(jobSystem **ppJobs, int numWorkers) {
+    gfmRV rv;
+    jobSystem *pJobs;
+    
+    pJobs = 0;
+    ASSERT(ppJobs, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppJobs), GFMRV_ARGUMENTS_BAD);
+    ASSERT(numWorkers >= 0, GFMRV_ARGUMENTS_BAD);
+    
+    pJobs = (jobSystem*)malloc(sizeof(jobSystem));
+    ASSERT(pJobs, GFMRV_ALLOC_FAILED);
+    memset(pJobs, 0x0, sizeof(jobSystem));
+    *ppJobs = pJobs;
+
+#if defined(JOBS_USE_THREADS)
+    if (numWorkers > 0) {
+        int i;
+        
+        pJobs->pThreads = (pthread_t*)malloc(sizeof(pthread_t) * numWorkers);
+        ASSERT(pJobs->pThreads, GFMRV_ALLOC_FAILED);
+        pJobs->pWorkers = (jobWorker*)malloc(sizeof(jobWorker) * numWorkers);
+        ASSERT(pJobs->pWorkers, GFMRV_ALLOC_FAILED);
+        pJobs->pDeques = (jobDeque*)malloc(sizeof(jobDeque) *
+                (numWorkers + 1));
+        ASSERT(pJobs->pDeques, GFMRV_ALLOC_FAILED);
+        memset(pJobs->pDeques, 0x0, sizeof(jobDeque) * (numWorkers + 1));
+        
+        pthread_mutex_init(&(pJobs->mutex), 0);
+        pthread_cond_init(&(pJobs->start), 0);
+        pthread_cond_init(&(pJobs->done), 0);
+        i = 0;
+        while (i < numWorkers + 1) {
+            pthread_mutex_init(&(pJobs->pDeques[i].mutex), 0);
+            i++;
+        }
+        pJobs->numWorkers = numWorkers;
+        
+        // Deque 0 belongs to the caller
+        i = 0;
+        while (i < numWorkers) {
+            pJobs->pWorkers[i].pJobs = pJobs;
+            pJobs->pWorkers[i].index = i + 1;
+            ASSERT(pthread_create(pJobs->pThreads + i, 0, jobs_workerMain,
+                    pJobs->pWorkers + i) == 0, GFMRV_INTERNAL_ERROR);
+            pJobs->numStarted++;
+            
+            i++;
+        }
+    }
+#endif
+
+    rv = GFMRV_OK;
+__ret:
+    if (rv != GFMRV_OK && pJobs) {
+        jobs_free(ppJobs);
+    }
+    return rv;
+}
+
+/**
+ * Stop every worker and free the job system's memory
+ */
+gfmRV jobs_free(jobSystem **ppJobs) {
+    gfmRV rv;
+    jobSystem *pJobs;
+    
+    ASSERT(ppJobs, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppJobs, GFMRV_ARGUMENTS_BAD);
+    pJobs = *ppJobs;
+
+#if defined(JOBS_USE_THREADS)
+    if (pJobs->numWorkers > 0) {
+        int i;
+        
+        pthread_mutex_lock(&(pJobs->mutex));
+        pJobs->quit = 1;
+        pthread_cond_broadcast(&(pJobs->start));
+        pthread_mutex_unlock(&(pJobs->mutex));
+        
+        i = 0;
+        while (i < pJobs->numStarted) {
+            pthread_join(pJobs->pThreads[i], 0);
+            i++;
+        }
+        
+        i = 0;
+        while (i < pJobs->numWorkers + 1) {
+            pthread_mutex_destroy(&(pJobs->pDeques[i].mutex));
+            free(pJobs->pDeques[i].pRanges);
+            i++;
+        }
+        pthread_cond_destroy(&(pJobs->done));
+        pthread_cond_destroy(&(pJobs->start));
+        pthread_mutex_destroy(&(pJobs->mutex));
+    }
+    free(pJobs->pDeques);
+    free(pJobs->pWorkers);
+    free(pJobs->pThreads);
+#endif
+    free(pJobs);
+    *ppJobs = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Split a loop into ranges and run them on every thread; Only returns after
+ * every range was run
+ */
+gfmRV jobs_parallelFor(jobSystem *pJobs, jobFunc func, void *pCtx, int num,
+        int grain) {
+    gfmRV rv;
+#if defined(JOBS_USE_THREADS)
+    int first, i, numDeques, numRanges;
+#endif
+
+    ASSERT(func, GFMRV_ARGUMENTS_BAD);
+    ASSERT(grain > 0, GFMRV_ARGUMENTS_BAD);
+    
+    if (num <= 0) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    // Not worth waking anyone up
+    if (!pJobs || pJobs->numWorkers == 0 || num <= grain) {
+        rv = func(pCtx, 0, num);
+        goto __ret;
+    }
+
+#if defined(JOBS_USE_THREADS)
+    numDeques = pJobs->numWorkers + 1;
+    numRanges = (num + grain - 1) / grain;
+    
+    // Ranges are dealt so every deque gets some
+    i = 0;
+    while (i < numDeques) {
+        jobDeque *pDeque;
+        int len;
+        
+        pDeque = pJobs->pDeques + i;
+        len = (numRanges + numDeques - 1) / numDeques;
+        
+        pthread_mutex_lock(&(pDeque->mutex));
+        if (len > pDeque->len) {
+            jobRange *pTmp;
+            
+            pTmp = (jobRange*)realloc(pDeque->pRanges, sizeof(jobRange) * len);
+            if (!pTmp) {
+                pthread_mutex_unlock(&(pDeque->mutex));
+                ASSERT(0, GFMRV_ALLOC_FAILED);
+            }
+            pDeque->pRanges = pTmp;
+            pDeque->len = len;
+        }
+        pDeque->top = 0;
+        pDeque->bottom = 0;
+        pthread_mutex_unlock(&(pDeque->mutex));
+        
+        i++;
+    }
+    
+    // A worker may still be looking for ranges from the previous loop, so
+    // everything must be set before the first range is queued
+    pJobs->func = func;
+    pJobs->pCtx = pCtx;
+    pthread_mutex_lock(&(pJobs->mutex));
+    pJobs->pending = numRanges;
+    pJobs->rv = GFMRV_OK;
+    pthread_mutex_unlock(&(pJobs->mutex));
+    
+    first = 0;
+    i = 0;
+    while (first < num) {
+        jobDeque *pDeque;
+        
+        pDeque = pJobs->pDeques + i % numDeques;
+        
+        pthread_mutex_lock(&(pDeque->mutex));
+        pDeque->pRanges[pDeque->bottom].first = first;
+        first += grain;
+        if (first > num) {
+            first = num;
+        }
+        pDeque->pRanges[pDeque->bottom].last = first;
+        pDeque->bottom++;
+        pthread_mutex_unlock(&(pDeque->mutex));
+        
+        i++;
+    }
+    
+    // Wake the workers and help them
+    pthread_mutex_lock(&(pJobs->mutex));
+    pJobs->generation++;
+    pthread_cond_broadcast(&(pJobs->start));
+    pthread_mutex_unlock(&(pJobs->mutex));
+    
+    jobs_work(pJobs, 0/*index*/);
+    
+    pthread_mutex_lock(&(pJobs->mutex));
+    while (pJobs->pending > 0) {
+        pthread_cond_wait(&(pJobs->done), &(pJobs->mutex));
+    }
+    rv = pJobs->rv;
+    pthread_mutex_unlock(&(pJobs->mutex));
+#else
+    rv = func(pCtx, 0, num);
+#endif
+
+__ret:
+    return rv;
+}
+
+/**
+ * Get how many threads run each loop (including the calling one)
+ */
+int jobs_getThreadCount(jobSystem *pJobs) {
+    if (!pJobs) {
+        return 1;
+    }
+    return pJobs->numWorkers + 1;
+}
+
+/**
+ * Get how many processors are online (1, if it can't be detected)
+ */
+int jobs_getCpuCount() {
+#if defined(_SC_NPROCESSORS_ONLN)
+    long num;
+    
+    num = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num > 0) {
+        return (int)num;
+    }
+#endif
+    return 1;
+}
+
@@ -0,0 +1,989 @@
+/**
+ * @file src/level.c
+ *
+ * Parsed level; Keeps every area and spawn point read from the map, so the
+ * playstate may be restarted without parsing it again
+ */
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmFile.h>
+#include <GFraMe/gfmParser.h>
+
+#include <ld33/game.h>
+#include <ld33/level.h>
+#include <ld33/levelfmt.h>
+#include <ld33/mob.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(EMSCRIPT) && !defined(_WIN32)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define LEVEL_USE_MMAP
+#endif
+
+struct stLevel {
+    /** Every static area */
+    levelArea *pAreas;
+    /** How many areas fit on the list */
+    int areasLen;
+    /** How many areas were parsed */
+    int numAreas;
+    /** Every spawn point */
+    levelSpawn *pSpawns;
+    /** How many spawns fit on the list */
+    int spawnsLen;
+    /** How many spawns were parsed */
+    int numSpawns;
+    /** World's width */
+    int width;
+    /** World's height */
+    int height;
+    /** Whether a map was already loaded */
+    int isLoaded;
+    /** Width of each chunk */
+    int chunkWidth;
+    /** How many chunks the level was split into */
+    int numChunks;
+    /** Index of each chunk's first spawn on pChunkSpawns (with an extra entry
+     * for the end of the last chunk) */
+    int *pChunkStart;
+    /** Index of every spawn, sorted by chunk */
+    int *pChunkSpawns;
+};
+
+/**
+ * Alloc a new level
+ */
+gfmRV level_getNew(level **ppLevel) {
+    gfmRV rv;
+    
+    ASSERT(ppLevel, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppLevel), GFMRV_ARGUMENTS_BAD);
+    
+    *ppLevel = (level*)malloc(sizeof(level));
+    ASSERT(*ppLevel, GFMRV_ALLOC_FAILED);
+    
+    memset(*ppLevel, 0x0, sizeof(level));
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Free a level's memory
+ */
+gfmRV level_free(level **ppLevel) {
+    gfmRV rv;
+    
+    ASSERT(ppLevel, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppLevel, GFMRV_ARGUMENTS_BAD);
+    
+    free((*ppLevel)->pAreas);
+    free((*ppLevel)->pSpawns);
+    free((*ppLevel)->pChunkStart);
+    free((*ppLevel)->pChunkSpawns);
+    free(*ppLevel);
+    *ppLevel = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Retrieve a new area, expanding the list as necessary
+ */
+static gfmRV level_getNextArea(levelArea **ppArea, level *pLevel) {
+    gfmRV rv;
+    
+    if (pLevel->numAreas >= pLevel->areasLen) {
+        levelArea *pTmp;
+        int len;
+        
+        len = pLevel->areasLen * 2 + 4;
+        pTmp = (levelArea*)realloc(pLevel->pAreas, sizeof(levelArea) * len);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pLevel->pAreas = pTmp;
+        pLevel->areasLen = len;
+    }
+    
+    *ppArea = pLevel->pAreas + pLevel->numAreas;
+    memset(*ppArea, 0x0, sizeof(levelArea));
+    pLevel->numAreas++;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Retrieve a new spawn point, expanding the list as necessary
+ */
+static gfmRV level_getNextSpawn(levelSpawn **ppSpawn, level *pLevel) {
+    gfmRV rv;
+    
+    if (pLevel->numSpawns >= pLevel->spawnsLen) {
+        levelSpawn *pTmp;
+        int len;
+        
+        len = pLevel->spawnsLen * 2 + 32;
+        pTmp = (levelSpawn*)realloc(pLevel->pSpawns, sizeof(levelSpawn) * len);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pLevel->pSpawns = pTmp;
+        pLevel->spawnsLen = len;
+    }
+    
+    *ppSpawn = pLevel->pSpawns + pLevel->numSpawns;
+    memset(*ppSpawn, 0x0, sizeof(levelSpawn));
+    pLevel->numSpawns++;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Read a shadow's properties
+ */
+static gfmRV level_parseShadow(levelSpawn *pSpawn, gfmParser *pParser) {
+    gfmRV rv;
+    int num;
+    
+    pSpawn->dist = 48;
+    pSpawn->level = 1;
+    pSpawn->subtype = EN_NONE;
+    pSpawn->traits = TR_NONE;
+    
+    rv = gfmParser_getNumProperties(&num, pParser);
+    ASSERT(rv == GFMRV_OK, rv);
+    while (num > 0) {
+        char *pKey, *pVal;
+        
+        rv = gfmParser_getProperty(&pKey, &pVal, pParser, num - 1);
+        ASSERT(rv == GFMRV_OK, rv);
+
+#define CHECK_KEY(str) strcmp(pKey, str) == 0
+#define CHECK_VAL(str) strcmp(pVal, str) == 0
+        if (CHECK_KEY("level")) {
+            pSpawn->level = 0;
+            while (*pVal) {
+                pSpawn->level = pSpawn->level * 10 + (*pVal) - '0';
+                pVal++;
+            }
+        }
+        else if (CHECK_KEY("subtype")) {
+            if (CHECK_VAL("slime")) pSpawn->subtype = EN_SLIME;
+            else if (CHECK_VAL("angrySlime")) pSpawn->subtype = EN_ANGRYSLIME;
+            else if (CHECK_VAL("swarmSlime")) pSpawn->subtype = EN_SWARMSLIME;
+            else ASSERT(0, GFMRV_INTERNAL_ERROR);
+        }
+        else if (CHECK_KEY("trait")) {
+            if (CHECK_VAL("coward")) pSpawn->traits |= TR_COWARD;
+            else if (CHECK_VAL("neutral")) pSpawn->traits |= TR_NEUTRAL;
+            else if (CHECK_VAL("angry")) pSpawn->traits |= TR_ANGRY;
+            else if (CHECK_VAL("swarmer")) pSpawn->traits |= TR_SWARMER;
+            else ASSERT(0, GFMRV_INTERNAL_ERROR);
+        }
+        else if (CHECK_KEY("dist")) {
+            pSpawn->dist = 0;
+            while (*pVal) {
+                pSpawn->dist = pSpawn->dist * 10 + (*pVal) - '0';
+                pVal++;
+            }
+        }
+        else {
+            ASSERT(0, GFMRV_INTERNAL_ERROR);
+        }
+#undef CHECK_VAL
+#undef CHECK_KEY
+        num--;
+    } // while num < numProps
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Parse a map and store everything on it
+ *
+ * @param  pLevel    The level
+ * @param  pCtx      The game's context
+ * @param  pFilename The map's filename (within the assets directory)
+ */
+gfmRV level_loadStatic(level *pLevel, gfmCtx *pCtx, char *pFilename) {
+    gfmParser *pParser;
+    gfmRV rv;
+    
+    pParser = 0;
+    
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pCtx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pFilename, GFMRV_ARGUMENTS_BAD);
+    
+    pLevel->numAreas = 0;
+    pLevel->numSpawns = 0;
+    pLevel->width = 0;
+    pLevel->height = 120;
+    pLevel->isLoaded = 0;
+    
+    rv = gfmParser_getNew(&pParser);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmParser_initStatic(pParser, pCtx, pFilename);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    while (rv != GFMRV_PARSER_FINISHED) {
+        char *pType;
+        gfmParserType type;
+        int x, y;
+        
+        rv = gfmParser_parseNext(pParser);
+        ASSERT(rv == GFMRV_OK || rv == GFMRV_PARSER_FINISHED, rv);
+        if (rv == GFMRV_PARSER_FINISHED) {
+            break;
+        }
+        
+        rv = gfmParser_getType(&type, pParser);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = gfmParser_getPos(&x, &y, pParser);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = gfmParser_getIngameType(&pType, pParser);
+        ASSERT(rv == GFMRV_OK, rv);
+
+#define CHECK_TYPE(str) strcmp(pType, str) == 0
+        if (type == gfmParserType_area) {
+            levelArea *pArea;
+            
+            rv = level_getNextArea(&pArea, pLevel);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            pArea->x = x;
+            pArea->y = y;
+            rv = gfmParser_getDimensions(&(pArea->width), &(pArea->height),
+                    pParser);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            if (CHECK_TYPE("win")) {
+                pArea->type = win;
+            }
+            else if (CHECK_TYPE("collideable")) {
+                pArea->type = collideable;
+                
+                // Get the world's dimensions
+                if (pArea->width > pLevel->width) {
+                    pLevel->width = pArea->width;
+                }
+            }
+            else {
+                ASSERT(0, GFMRV_INTERNAL_ERROR);
+            }
+        } // if type == area
+        else if (type == gfmParserType_object) {
+            levelSpawn *pSpawn;
+            
+            rv = level_getNextSpawn(&pSpawn, pLevel);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            pSpawn->x = x;
+            pSpawn->y = y;
+            pSpawn->level = 1;
+            
+            if (CHECK_TYPE("player")) {
+                pSpawn->type = player;
+            }
+            else if (CHECK_TYPE("shadow")) {
+                pSpawn->type = shadow;
+                
+                rv = level_parseShadow(pSpawn, pParser);
+                ASSERT(rv == GFMRV_OK, rv);
+            }
+            else if (CHECK_TYPE("wall")) {
+                pSpawn->type = wall;
+            }
+            else {
+                ASSERT(0, GFMRV_INTERNAL_ERROR);
+            }
+        }
+        else {
+            ASSERT(0, GFMRV_INTERNAL_ERROR);
+        }
+#undef CHECK_TYPE
+    }
+    
+    pLevel->isLoaded = 1;
+    rv = GFMRV_OK;
+__ret:
+    gfmParser_free(&pParser);
+    
+    return rv;
+}
+
+/** A token within a mapped level (not NUL-terminated) */
+struct stLevelSlice {
+    const char *pStr;
+    int len;
+};
+typedef struct stLevelSlice levelSlice;
+
+/**
+ * Retrieve the next whitespace-separated token
+ *
+ * @param  pSlice The token
+ * @param  ppCur  Current position within the level (updated to the token's
+ *                end)
+ * @param  pEnd   End of the level
+ * @return        GFMRV_OK, GFMRV_FILE_EOF_REACHED
+ */
+static gfmRV level_nextSlice(levelSlice *pSlice, const char **ppCur,
+        const char *pEnd) {
+    const char *pCur;
+    
+    pCur = *ppCur;
+    while (pCur < pEnd && (*pCur == ' ' || *pCur == '\t' || *pCur == '\r' ||
+            *pCur == '\n')) {
+        pCur++;
+    }
+    if (pCur >= pEnd) {
+        *ppCur = pCur;
+        return GFMRV_FILE_EOF_REACHED;
+    }
+    
+    pSlice->pStr = pCur;
+    while (pCur < pEnd && *pCur != ' ' && *pCur != '\t' && *pCur != '\r' &&
+            *pCur != '\n') {
+        pCur++;
+    }
+    pSlice->len = (int)(pCur - pSlice->pStr);
+    *ppCur = pCur;
+    
+    return GFMRV_OK;
+}
+
+/**
+ * Check whether a token matches a string
+ */
+static int level_isSlice(levelSlice *pSlice, const char *pStr) {
+    int i;
+    
+    i = 0;
+    while (i < pSlice->len) {
+        if (pStr[i] != pSlice->pStr[i]) {
+            return 0;
+        }
+        i++;
+    }
+    return pStr[i] == '\0';
+}
+
+/**
+ * Retrieve the next token as an integer
+ */
+static gfmRV level_nextInt(int *pVal, const char **ppCur, const char *pEnd) {
+    gfmRV rv;
+    levelSlice slice;
+    int i, isNeg;
+    
+    rv = level_nextSlice(&slice, ppCur, pEnd);
+    ASSERT(rv == GFMRV_OK, GFMRV_READ_ERROR);
+    
+    i = 0;
+    isNeg = 0;
+    if (slice.pStr[0] == '-') {
+        isNeg = 1;
+        i++;
+    }
+    ASSERT(i < slice.len, GFMRV_READ_ERROR);
+    
+    *pVal = 0;
+    while (i < slice.len) {
+        ASSERT(slice.pStr[i] >= '0' && slice.pStr[i] <= '9', GFMRV_READ_ERROR);
+        *pVal = (*pVal) * 10 + slice.pStr[i] - '0';
+        i++;
+    }
+    if (isNeg) {
+        *pVal = -(*pVal);
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Read every property of an object (i.e., "[ key , value ]") into its spawn
+ *
+ * @param  pSpawn The spawn point
+ * @param  pNext  The token just after the properties
+ * @param  ppCur  Current position within the level
+ * @param  pEnd   End of the level
+ */
+static gfmRV level_tokenizeProperties(levelSpawn *pSpawn, levelSlice *pNext,
+        const char **ppCur, const char *pEnd) {
+    gfmRV rv;
+    
+    rv = level_nextSlice(pNext, ppCur, pEnd);
+    while (rv == GFMRV_OK && level_isSlice(pNext, "[")) {
+        levelSlice key, val, tmp;
+        
+        rv = level_nextSlice(&key, ppCur, pEnd);
+        ASSERT(rv == GFMRV_OK, GFMRV_READ_ERROR);
+        rv = level_nextSlice(&tmp, ppCur, pEnd);
+        ASSERT(rv == GFMRV_OK && level_isSlice(&tmp, ","), GFMRV_READ_ERROR);
+
+#define CHECK_KEY(str) level_isSlice(&key, str)
+#define CHECK_VAL(str) level_isSlice(&val, str)
+        if (CHECK_KEY("level")) {
+            rv = level_nextInt(&(pSpawn->level), ppCur, pEnd);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        else if (CHECK_KEY("dist")) {
+            rv = level_nextInt(&(pSpawn->dist), ppCur, pEnd);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        else {
+            rv = level_nextSlice(&val, ppCur, pEnd);
+            ASSERT(rv == GFMRV_OK, GFMRV_READ_ERROR);
+            
+            if (CHECK_KEY("subtype")) {
+                if (CHECK_VAL("slime")) pSpawn->subtype = EN_SLIME;
+                else if (CHECK_VAL("angrySlime")) pSpawn->subtype = EN_ANGRYSLIME;
+                else if (CHECK_VAL("swarmSlime")) pSpawn->subtype = EN_SWARMSLIME;
+                else ASSERT(0, GFMRV_READ_ERROR);
+            }
+            else if (CHECK_KEY("trait")) {
+                if (CHECK_VAL("coward")) pSpawn->traits |= TR_COWARD;
+                else if (CHECK_VAL("neutral")) pSpawn->traits |= TR_NEUTRAL;
+                else if (CHECK_VAL("angry")) pSpawn->traits |= TR_ANGRY;
+                else if (CHECK_VAL("swarmer")) pSpawn->traits |= TR_SWARMER;
+                else ASSERT(0, GFMRV_READ_ERROR);
+            }
+            else {
+                ASSERT(0, GFMRV_READ_ERROR);
+            }
+        }
+#undef CHECK_VAL
+#undef CHECK_KEY
+
+        rv = level_nextSlice(&tmp, ppCur, pEnd);
+        ASSERT(rv == GFMRV_OK && level_isSlice(&tmp, "]"), GFMRV_READ_ERROR);
+        
+        rv = level_nextSlice(pNext, ppCur, pEnd);
+    }
+    // Reaching the end of the level is fine here
+    if (rv == GFMRV_FILE_EOF_REACHED) {
+        pNext->len = 0;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Tokenize every record of a text level straight from its bytes
+ */
+static gfmRV level_tokenize(level *pLevel, const char *pData, int size) {
+    const char *pCur, *pEnd;
+    gfmRV rv;
+    levelSlice slice;
+    
+    pCur = pData;
+    pEnd = pData + size;
+    
+    pLevel->numAreas = 0;
+    pLevel->numSpawns = 0;
+    pLevel->width = 0;
+    pLevel->height = 120;
+    
+    rv = level_nextSlice(&slice, &pCur, pEnd);
+    while (rv == GFMRV_OK && slice.len > 0) {
+        levelSlice type;
+        int h, w, x, y;
+        
+        rv = level_nextSlice(&type, &pCur, pEnd);
+        ASSERT(rv == GFMRV_OK, GFMRV_READ_ERROR);
+        rv = level_nextInt(&x, &pCur, pEnd);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = level_nextInt(&y, &pCur, pEnd);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = level_nextInt(&w, &pCur, pEnd);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = level_nextInt(&h, &pCur, pEnd);
+        ASSERT(rv == GFMRV_OK, rv);
+
+#define CHECK_TYPE(str) level_isSlice(&type, str)
+        if (level_isSlice(&slice, "area")) {
+            levelArea *pArea;
+            
+            rv = level_getNextArea(&pArea, pLevel);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            pArea->x = x;
+            pArea->y = y;
+            pArea->width = w;
+            pArea->height = h;
+            
+            if (CHECK_TYPE("win")) {
+                pArea->type = win;
+            }
+            else if (CHECK_TYPE("collideable")) {
+                pArea->type = collideable;
+                
+                // Get the world's dimensions
+                if (w > pLevel->width) {
+                    pLevel->width = w;
+                }
+            }
+            else {
+                ASSERT(0, GFMRV_READ_ERROR);
+            }
+            
+            rv = level_nextSlice(&slice, &pCur, pEnd);
+        }
+        else if (level_isSlice(&slice, "obj")) {
+            levelSpawn *pSpawn;
+            
+            rv = level_getNextSpawn(&pSpawn, pLevel);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            pSpawn->x = x;
+            pSpawn->y = y;
+            pSpawn->level = 1;
+            pSpawn->dist = 48;
+            
+            if (CHECK_TYPE("player")) pSpawn->type = player;
+            else if (CHECK_TYPE("shadow")) pSpawn->type = shadow;
+            else if (CHECK_TYPE("wall")) pSpawn->type = wall;
+            else ASSERT(0, GFMRV_READ_ERROR);
+            
+            rv = level_tokenizeProperties(pSpawn, &slice, &pCur, pEnd);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        else {
+            ASSERT(0, GFMRV_READ_ERROR);
+        }
+#undef CHECK_TYPE
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Load a text level (same format as map.gfm) from the filesystem; The file is
+ * mapped read-only into memory and tokenized in place, without copying any
+ * token (if mapping isn't available, it's read into a buffer in a single go)
+ *
+ * @param  pLevel The level
+ * @param  pPath  Path to the level (not within the assets directory)
+ */
+gfmRV level_loadMapped(level *pLevel, char *pPath) {
+    gfmRV rv;
+    char *pData;
+    int size;
+#if defined(LEVEL_USE_MMAP)
+    struct stat st;
+    int fd;
+    
+    fd = -1;
+#else
+    FILE *pFp;
+    
+    pFp = 0;
+#endif
+    pData = 0;
+    size = 0;
+    
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pPath, GFMRV_ARGUMENTS_BAD);
+    
+    pLevel->isLoaded = 0;
+
+#if defined(LEVEL_USE_MMAP)
+    fd = open(pPath, O_RDONLY);
+    ASSERT(fd >= 0, GFMRV_FILE_NOT_FOUND);
+    ASSERT(fstat(fd, &st) == 0, GFMRV_READ_ERROR);
+    size = (int)st.st_size;
+    ASSERT(size > 0, GFMRV_READ_ERROR);
+    
+    pData = (char*)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pData == MAP_FAILED) {
+        pData = 0;
+    }
+    ASSERT(pData, GFMRV_READ_ERROR);
+    // Let the kernel know it will be read only once, from start to end
+    madvise(pData, size, MADV_SEQUENTIAL);
+#else
+    pFp = fopen(pPath, "rb");
+    ASSERT(pFp, GFMRV_FILE_NOT_FOUND);
+    ASSERT(fseek(pFp, 0, SEEK_END) == 0, GFMRV_READ_ERROR);
+    size = (int)ftell(pFp);
+    ASSERT(size > 0, GFMRV_READ_ERROR);
+    ASSERT(fseek(pFp, 0, SEEK_SET) == 0, GFMRV_READ_ERROR);
+    
+    pData = (char*)malloc(size);
+    ASSERT(pData, GFMRV_ALLOC_FAILED);
+    ASSERT(fread(pData, 1, size, pFp) == (size_t)size, GFMRV_READ_ERROR);
+#endif
+
+    rv = level_tokenize(pLevel, pData, size);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    pLevel->isLoaded = 1;
+    rv = GFMRV_OK;
+__ret:
+#if defined(LEVEL_USE_MMAP)
+    if (pData) {
+        munmap(pData, size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+#else
+    if (pFp) {
+        fclose(pFp);
+    }
+    free(pData);
+#endif
+
+    return rv;
+}
+
+/**
+ * Decode a field from a compiled level
+ *
+ * @param  pData The level's data
+ * @param  i     Index of the field
+ */
+static int level_getField(unsigned char *pData, int i) {
+    unsigned int val;
+    
+    pData += i * LVL_FIELD_SIZE;
+    val = pData[0];
+    val |= pData[1] << 8;
+    val |= pData[2] << 16;
+    val |= (unsigned int)pData[3] << 24;
+    
+    return (int)val;
+}
+
+/**
+ * Load a level compiled by tools/mapc.c; The whole file is read at once and
+ * the records are decoded directly into the spawn tables
+ *
+ * @param  pLevel    The level
+ * @param  pCtx      The game's context
+ * @param  pFilename The compiled level's filename (within the assets
+ *                   directory)
+ */
+gfmRV level_loadBinary(level *pLevel, gfmCtx *pCtx, char *pFilename) {
+    gfmFile *pFile;
+    gfmRV rv;
+    int count, i, n, numAreas, numSpawns, size;
+    unsigned char *pData;
+    
+    pFile = 0;
+    pData = 0;
+    
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pCtx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pFilename, GFMRV_ARGUMENTS_BAD);
+    
+    pLevel->isLoaded = 0;
+    
+    rv = gfmFile_getNew(&pFile);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmFile_openAsset(pFile, pCtx, pFilename, strlen(pFilename),
+            0/*isText*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmFile_getSize(&size, pFile);
+    ASSERT(rv == GFMRV_OK, rv);
+    ASSERT(size >= LVL_HEADER_FIELDS * LVL_FIELD_SIZE, GFMRV_READ_ERROR);
+    
+    pData = (unsigned char*)malloc(size);
+    ASSERT(pData, GFMRV_ALLOC_FAILED);
+    rv = gfmFile_readBytes((char*)pData, &count, pFile, size);
+    ASSERT(rv == GFMRV_OK, rv);
+    ASSERT(count == size, GFMRV_READ_ERROR);
+    
+    // Check the header
+    ASSERT(level_getField(pData, 0) == LVL_MAGIC, GFMRV_READ_ERROR);
+    ASSERT(level_getField(pData, 1) == LVL_VERSION, GFMRV_READ_ERROR);
+    numAreas = level_getField(pData, 4);
+    numSpawns = level_getField(pData, 5);
+    ASSERT(numAreas >= 0 && numSpawns >= 0, GFMRV_READ_ERROR);
+    ASSERT(size == (LVL_HEADER_FIELDS + numAreas * LVL_AREA_FIELDS +
+            numSpawns * LVL_SPAWN_FIELDS) * LVL_FIELD_SIZE, GFMRV_READ_ERROR);
+    
+    pLevel->width = level_getField(pData, 2);
+    pLevel->height = level_getField(pData, 3);
+    
+    // Expand the tables only once
+    if (numAreas > pLevel->areasLen) {
+        levelArea *pTmp;
+        
+        pTmp = (levelArea*)realloc(pLevel->pAreas,
+                sizeof(levelArea) * numAreas);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pLevel->pAreas = pTmp;
+        pLevel->areasLen = numAreas;
+    }
+    if (numSpawns > pLevel->spawnsLen) {
+        levelSpawn *pTmp;
+        
+        pTmp = (levelSpawn*)realloc(pLevel->pSpawns,
+                sizeof(levelSpawn) * numSpawns);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pLevel->pSpawns = pTmp;
+        pLevel->spawnsLen = numSpawns;
+    }
+    
+    n = LVL_HEADER_FIELDS;
+    i = 0;
+    while (i < numAreas) {
+        levelArea *pArea;
+        
+        pArea = pLevel->pAreas + i;
+        switch (level_getField(pData, n)) {
+            case LVL_AREA_COLLIDEABLE: pArea->type = collideable; break;
+            case LVL_AREA_WIN: pArea->type = win; break;
+            default: ASSERT(0, GFMRV_READ_ERROR);
+        }
+        pArea->x = level_getField(pData, n + 1);
+        pArea->y = level_getField(pData, n + 2);
+        pArea->width = level_getField(pData, n + 3);
+        pArea->height = level_getField(pData, n + 4);
+        
+        n += LVL_AREA_FIELDS;
+        i++;
+    }
+    pLevel->numAreas = numAreas;
+    
+    i = 0;
+    while (i < numSpawns) {
+        levelSpawn *pSpawn;
+        
+        pSpawn = pLevel->pSpawns + i;
+        switch (level_getField(pData, n)) {
+            case LVL_OBJ_PLAYER: pSpawn->type = player; break;
+            case LVL_OBJ_SHADOW: pSpawn->type = shadow; break;
+            case LVL_OBJ_WALL: pSpawn->type = wall; break;
+            default: ASSERT(0, GFMRV_READ_ERROR);
+        }
+        pSpawn->x = level_getField(pData, n + 1);
+        pSpawn->y = level_getField(pData, n + 2);
+        pSpawn->level = level_getField(pData, n + 3);
+        pSpawn->subtype = level_getField(pData, n + 4);
+        pSpawn->traits = level_getField(pData, n + 5);
+        pSpawn->dist = level_getField(pData, n + 6);
+        
+        n += LVL_SPAWN_FIELDS;
+        i++;
+    }
+    pLevel->numSpawns = numSpawns;
+    
+    pLevel->isLoaded = 1;
+    rv = GFMRV_OK;
+__ret:
+    if (pFile) {
+        gfmFile_free(&pFile);
+    }
+    free(pData);
+    
+    return rv;
+}
+
+/**
+ * Get the chunk that contains a horizontal position
+ */
+static int level_getChunkAt(level *pLevel, int x) {
+    int chunk;
+    
+    chunk = x / pLevel->chunkWidth;
+    if (x < 0) {
+        chunk = 0;
+    }
+    else if (chunk >= pLevel->numChunks) {
+        chunk = pLevel->numChunks - 1;
+    }
+    
+    return chunk;
+}
+
+/**
+ * Split the level into horizontal chunks, so spawns may be retrieved only
+ * around the camera; Must be called after loading the level
+ * 
+ * @param  pLevel     The level
+ * @param  chunkWidth Width of each chunk
+ */
+gfmRV level_indexChunks(level *pLevel, int chunkWidth) {
+    gfmRV rv;
+    int i, *pTmp;
+    
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pLevel->isLoaded, GFMRV_ARGUMENTS_BAD);
+    ASSERT(chunkWidth > 0, GFMRV_ARGUMENTS_BAD);
+    
+    pLevel->chunkWidth = chunkWidth;
+    pLevel->numChunks = (pLevel->width + chunkWidth - 1) / chunkWidth;
+    if (pLevel->numChunks <= 0) {
+        pLevel->numChunks = 1;
+    }
+    
+    pTmp = (int*)realloc(pLevel->pChunkStart,
+            sizeof(int) * (pLevel->numChunks + 1));
+    ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+    pLevel->pChunkStart = pTmp;
+    if (pLevel->numSpawns > 0) {
+        pTmp = (int*)realloc(pLevel->pChunkSpawns,
+                sizeof(int) * pLevel->numSpawns);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pLevel->pChunkSpawns = pTmp;
+    }
+    
+    // Count how many spawns there are on each chunk...
+    memset(pLevel->pChunkStart, 0x0, sizeof(int) * (pLevel->numChunks + 1));
+    i = 0;
+    while (i < pLevel->numSpawns) {
+        pLevel->pChunkStart[level_getChunkAt(pLevel,
+                pLevel->pSpawns[i].x) + 1]++;
+        i++;
+    }
+    // ...convert it into each chunk's first index...
+    i = 0;
+    while (i < pLevel->numChunks) {
+        pLevel->pChunkStart[i + 1] += pLevel->pChunkStart[i];
+        i++;
+    }
+    // ...and place every spawn on its chunk (keeping the parsed order)
+    i = 0;
+    while (i < pLevel->numSpawns) {
+        int chunk;
+        
+        chunk = level_getChunkAt(pLevel, pLevel->pSpawns[i].x);
+        pLevel->pChunkSpawns[pLevel->pChunkStart[chunk]] = i;
+        pLevel->pChunkStart[chunk]++;
+        i++;
+    }
+    // Every start was moved to the next chunk's start, so shift them back
+    i = pLevel->numChunks;
+    while (i > 0) {
+        pLevel->pChunkStart[i] = pLevel->pChunkStart[i - 1];
+        i--;
+    }
+    pLevel->pChunkStart[0] = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Get how many chunks the level was split into
+ */
+int level_getChunkCount(level *pLevel) {
+    return pLevel->numChunks;
+}
+
+/**
+ * Get the index (on the list from level_getSpawns) of every spawn within a
+ * chunk
+ * 
+ * @param  ppIndices The indices; The list is owned by the level
+ * @param  pNum      How many spawns there are on the chunk
+ * @param  pLevel    The level
+ * @param  chunk     The chunk
+ */
+gfmRV level_getChunkSpawns(int **ppIndices, int *pNum, level *pLevel,
+        int chunk) {
+    gfmRV rv;
+    
+    ASSERT(ppIndices, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pNum, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    ASSERT(chunk >= 0 && chunk < pLevel->numChunks, GFMRV_ARGUMENTS_BAD);
+    
+    *ppIndices = pLevel->pChunkSpawns + pLevel->pChunkStart[chunk];
+    *pNum = pLevel->pChunkStart[chunk + 1] - pLevel->pChunkStart[chunk];
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Check whether a map was already loaded
+ *
+ * @return GFMRV_TRUE, GFMRV_FALSE
+ */
+gfmRV level_isLoaded(level *pLevel) {
+    if (pLevel->isLoaded) {
+        return GFMRV_TRUE;
+    }
+    return GFMRV_FALSE;
+}
+
+/**
+ * Get the world's dimensions
+ */
+gfmRV level_getDimensions(int *pWidth, int *pHeight, level *pLevel) {
+    gfmRV rv;
+    
+    ASSERT(pWidth, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pHeight, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    
+    *pWidth = pLevel->width;
+    *pHeight = pLevel->height;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Get every static area; The list is owned by the level
+ */
+gfmRV level_getAreas(levelArea **ppAreas, int *pNum, level *pLevel) {
+    gfmRV rv;
+    
+    ASSERT(ppAreas, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pNum, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    
+    *ppAreas = pLevel->pAreas;
+    *pNum = pLevel->numAreas;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Get every spawn point, in the order they were parsed; The list is owned by
+ * the level
+ */
+gfmRV level_getSpawns(levelSpawn **ppSpawns, int *pNum, level *pLevel) {
+    gfmRV rv;
+    
+    ASSERT(ppSpawns, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pNum, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pLevel, GFMRV_ARGUMENTS_BAD);
+    
+    *ppSpawns = pLevel->pSpawns;
+    *pNum = pLevel->numSpawns;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
@@ -4,11 +4,13 @@
  * The game's entry point
  */
 #include <ld33/blastate.h>
+#include <ld33/collision.h>
 #include <ld33/game.h>
 #include <ld33/introstate.h>
 #include <ld33/main.h>
 #include <ld33/playstate.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
 
@@ -102,6 +104,7 @@ gfmRV main_getKeyStates(gameCtx *pGame) {
     GET_KEY_STATE(up);
     GET_KEY_STATE(atk);
     GET_KEY_STATE(quit);
+    GET_KEY_STATE(broadphase);
     
 #undef GET_KEY_STATE
     
@@ -147,13 +150,12 @@ static gfmRV loadAssets(gameCtx *pGame) {
         texIndex, 256/*tileWidth*/, 128/*tileHeight*/);
     ASSERT(rv == GFMRV_OK, rv);
     
-#ifdef EMSCRIPT
-#else
-    rv = gfm_loadAudio(&(pGame->song), pGame->pCtx, "mysong.wav", 10);
+    // The song is synthesized while it plays, so only its source is loaded
+    rv = music_getNew(&(pGame->pMusic));
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfm_setRepeat(pGame->pCtx, pGame->song, 6 * pGame->audioFreq );
+    rv = music_load(pGame->pMusic, pGame->pCtx, "mml/song.mml",
+            pGame->audioFreq);
     ASSERT(rv == GFMRV_OK, rv);
-#endif
     
     rv = gfm_loadAudio(&(pGame->expl), pGame->pCtx, "expl.wav", 8);
     ASSERT(rv == GFMRV_OK, rv);
@@ -168,6 +170,30 @@ static gfmRV loadAssets(gameCtx *pGame) {
     rv = gfm_loadAudio(&(pGame->pl_death), pGame->pCtx, "player_death.wav", 16);
     ASSERT(rv == GFMRV_OK, rv);
     
+    // Register the sound effects; The player's are the most important ones
+    // and each sound's length is a rough estimate (a little shorter than the
+    // audio)
+    rv = sfx_getNew(&(pGame->pSfx), 8/*maxVoices*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = sfx_setSound(pGame->pSfx, SFX_EXPL, pGame->expl, 2/*priority*/,
+            2/*maxVoices*/, 600/*ms*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = sfx_setSound(pGame->pSfx, SFX_WALL_HIT, pGame->wall_hit, 0/*priority*/,
+            2/*maxVoices*/, 200/*ms*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = sfx_setSound(pGame->pSfx, SFX_SLIME_HIT, pGame->slime_hit,
+            0/*priority*/, 3/*maxVoices*/, 250/*ms*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = sfx_setSound(pGame->pSfx, SFX_SLIME_DEATH, pGame->slime_death,
+            1/*priority*/, 3/*maxVoices*/, 500/*ms*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = sfx_setSound(pGame->pSfx, SFX_PL_HIT, pGame->pl_hit, 3/*priority*/,
+            1/*maxVoices*/, 250/*ms*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = sfx_setSound(pGame->pSfx, SFX_PL_DEATH, pGame->pl_death,
+            4/*priority*/, 1/*maxVoices*/, 800/*ms*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    
     
     rv = GFMRV_OK;
 __ret:
@@ -182,8 +208,8 @@ int main(int argc, char *argv[]) {
     gfmAudioQuality audSettings;
     gfmInput *pInput;
     gfmRV rv;
-    int bbufWidth, bbufHeight, doSkip, dps, fps, height, isFullscreen, ups,
-            width;
+    int bbufWidth, bbufHeight, doSkip, dps, fps, height, isFullscreen, isMute,
+            ups, width;
     
     DESPAIR_LOG("Hero's Quest - by GFM\n");
     
@@ -208,10 +234,13 @@ int main(int argc, char *argv[]) {
     isFullscreen = 0;
     width = 640;
     height = 480;
-    game.maxParts = 2048;
+    game.maxParts = 100000;
+    game.sleepMargin = 64;
+    game.numThreads = 0;
     game.audioFreq = 44100;
     audSettings = gfmAudio_defQuality;
     doSkip = 0;
+    isMute = 0;
     
 #ifndef EMSCRIPT
     while (argc > 1) {
@@ -223,9 +252,38 @@ int main(int argc, char *argv[]) {
         else if (GETARG("-skip") || GETARG("-s")) {
             doSkip = 1;
         }
+        else if (GETARG("-grid") || GETARG("-g")) {
+            game.broadphase = broadphase_grid;
+        }
+        else if (GETARG("-level")) {
+            game.pLevelPath = argv[argc];
+        }
+        else if (GETARG("-margin")) {
+            char *pTmp;
+            
+            game.sleepMargin = 0;
+            pTmp = argv[argc];
+            while (*pTmp) {
+                game.sleepMargin = game.sleepMargin * 10 + (*pTmp) - '0';
+                
+                pTmp++;
+            }
+        }
+        else if (GETARG("-threads")) {
+            char *pTmp;
+            
+            game.numThreads = 0;
+            pTmp = argv[argc];
+            while (*pTmp) {
+                game.numThreads = game.numThreads * 10 + (*pTmp) - '0';
+                
+                pTmp++;
+            }
+        }
         else if (GETARG("-noaudio") || GETARG("-m")) {
             rv =  gfm_disableAudio(game.pCtx);
             ASSERT(rv == GFMRV_OK, rv);
+            isMute = 1;
         }
         else if (GETARG("-badaudio") || GETARG("-l")) {
             // TODO Test with lowQuality
@@ -328,6 +386,7 @@ int main(int argc, char *argv[]) {
     BIND_NEW_KEY(atk, gfmKey_x);
     BIND_KEY(atk, gfmKey_space);
     BIND_NEW_KEY(quit, gfmKey_esc);
+    BIND_NEW_KEY(broadphase, gfmKey_b);
     DESPAIR_LOG("OK\n");
     
 #undef BIND_NEW_KEY
@@ -366,14 +425,37 @@ int main(int argc, char *argv[]) {
     ASSERT(rv == GFMRV_OK, rv);
     DESPAIR_LOG(" OK\n");
     
-    // Play the song
-#ifdef EMSCRIPT
-#else
-    DESPAIR_LOG("Playing song...");
-    rv = gfm_playAudio(0, game.pCtx, game.song, 0.8);
+    // Initialize the static collision layer and the alternative broadphase
+    DESPAIR_LOG("Initializing collision grids...");
+    rv = grid_getNew(&(game.pStatic));
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = grid_getNew(&(game.pGrid));
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = grid_getNew(&(game.pView));
+    ASSERT(rv == GFMRV_OK, rv);
+    DESPAIR_LOG(" OK\n");
+    
+    DESPAIR_LOG("Initializing flowfield...");
+    rv = flowfield_getNew(&(game.pFlow));
     ASSERT(rv == GFMRV_OK, rv);
     DESPAIR_LOG(" OK\n");
-#endif
+    
+    // Start the workers (the main thread also works, so it isn't counted)
+    DESPAIR_LOG("Initializing job system...");
+    if (game.numThreads <= 0) {
+        game.numThreads = jobs_getCpuCount();
+    }
+    rv = jobs_getNew(&(game.pJobs), game.numThreads - 1);
+    ASSERT(rv == GFMRV_OK, rv);
+    DESPAIR_LOG(" OK\n");
+    
+    // Play the song
+    if (!isMute) {
+        DESPAIR_LOG("Playing song...");
+        rv = music_play(game.pMusic, 0.8);
+        ASSERT(rv == GFMRV_OK, rv);
+        DESPAIR_LOG(" OK\n");
+    }
     
     // Loop...
     game.state = state_introstate;
@@ -407,9 +489,38 @@ __ret:
     return rv;
 #else
     // Clean all resources
+    playstate_free(&game);
     gfmGroup_free(&(game.pRender));
     gfmGenArr_clean(game.pObjs, gfmObject_free);
     gfmQuadtree_free(&(game.pQt));
+    if (game.pStatic) {
+        grid_free(&(game.pStatic));
+    }
+    if (game.pGrid) {
+        grid_free(&(game.pGrid));
+    }
+    if (game.pView) {
+        grid_free(&(game.pView));
+    }
+    if (game.pFlow) {
+        flowfield_free(&(game.pFlow));
+    }
+    if (game.pJobs) {
+        jobs_free(&(game.pJobs));
+    }
+    if (game.pMusic) {
+        music_free(&(game.pMusic));
+    }
+    if (game.pSfx) {
+        int dropped, merged;
+        
+        // Always reported (unlike DESPAIR_LOG, which is only on the web build)
+        sfx_getStats(&merged, &dropped, game.pSfx);
+        fprintf(stderr, "Sound effects: %i merged, %i dropped\n", merged,
+                dropped);
+        sfx_free(&(game.pSfx));
+    }
+    collide_free();
     gfm_free(&(game.pCtx));
     
     return rv;
@@ -9,12 +9,22 @@
 #include <ld33/collision.h>
 #include <ld33/main.h>
 #include <ld33/mob.h>
+#include <ld33/playstate.h>
+#include <ld33/sfx.h>
 
 #include <stdlib.h>
 #include <string.h>
 
 #define NEG_INF -100000
 
+/** Area around a mob where it can see others */
+#define SCAN_WIDTH  64
+#define SCAN_HEIGHT 24
+
+/** How many particles burst out of a wall's explosion and a slime's death */
+#define EXPL_PARTS  256
+#define SLIME_PARTS 128
+
 enum {
     ANIM_STAND = 0,
     ANIM_WALK,
@@ -107,35 +117,29 @@ enum {
 struct stMob {
     /** The mob's sprite and main hitbox */
     gfmSprite *pSelf;
-    /** Hitbox to detect what around the mob */
-    gfmObject *pScan;
     /** Hitbox to attack stuff */
     gfmObject *pAtk;
-    /** Whether this mob is alive */
-    int isAlive;
+    /** Block (and slot within it) that keeps the mob's hot state (i.e., whether
+     * it's alive, its health, attack, traits and timers) */
+    struct stMobChunk *pChunk;
+    int slot;
+    /** Index of the level's spawn that created this mob (-1 if none) */
+    int spawnId;
     /** The mob's level defines it's health and attack */
     int level;
-    /** Current health (max can be calculated from the level */
-    int health;
-    /** Current attack power (i.e., how much damage it deal) */
-    int atkPower;
     /** (Redundant) The mob's type */
     int type;
-    /** Traits */
-    int traits;
     /** Previous movement */
     int lastMove;
     /** For how long we can dash */
     int dashTime;
-    /** For how long we've been dashing */
-    int curDashTimer;
     int isAttacking;
     int isHurt;
-    int invulnerableTime;
     int nearbyShadowCount;
     int dist;
-    int distX;
-    int distY;
+    /** Strongest hit taken on this frame (yet to be resolved); -1 if it wasn't
+     * hit (0 is a valid power, e.g. slimes' attacks) */
+    int hitPower;
     int plLastPosX;
     int plLastPosY;
     /** Horizontal speed when dashing */
@@ -148,29 +152,256 @@ struct stMob {
     double verSpeed;
 };
 
-static gfmRV mob_getDist(int *pDist, mob *pSelf, int ox, int oy) {
+/** Behaviour of a shadow on the current frame */
+enum {
+    SHADOW_CHASE = 0,
+    SHADOW_FLEE,
+    SHADOW_IDLE
+};
+
+/** How many integer arrays there are on a shadow batch */
+#define SHADOW_BATCH_INTS 9
+
+/** Packed state of shadows updated together; Each array has one entry per
+ * shadow, sorted by behaviour (chasing ones first, then fleeing and idle) */
+struct stShadowBatch {
+    /** The shadows */
+    mob **ppMobs;
+    /** Shadows in the order they were found (before sorting) */
+    mob **ppTmp;
+    /** Buffer where every integer array is stored */
+    int *pData;
+    /** Behaviour of each shadow (in the order they were found) */
+    int *pMode;
+    /** Shadow's center */
+    int *pX;
+    int *pY;
+    /** Player's last known position */
+    int *pTgtX;
+    int *pTgtY;
+    /** Squared distance within which the shadow reacts to the player (-1, if
+     * it never saw the player) */
+    int *pMaxDist;
+    /** Direction to move (-1, 0 or 1) */
+    int *pDirX;
+    int *pDirY;
+    /** Whether the shadow attacks */
+    int *pAttack;
+    /** How many shadows fit on the batch */
+    int len;
+    /** How many shadows are on the batch */
+    int num;
+    /** How many shadows are chasing the player (the first ones) */
+    int numChase;
+    /** How many shadows are fleeing (right after the chasing ones) */
+    int numFlee;
+};
+typedef struct stShadowBatch shadowBatch;
+
+/** Everything needed to decide part of a batch (on any thread) */
+struct stShadowJob {
+    shadowBatch *pBatch;
+    gameCtx *pGame;
+};
+typedef struct stShadowJob shadowJob;
+
+/** How many shadows are decided at once by each thread */
+#define SHADOW_GRAIN 64
+
+/** How many mobs are alloc'ed at once */
+#define MOB_CHUNK_LEN 256
+
+/** A block of mobs; The state that is read for most mobs on every frame is
+ * kept on parallel arrays, indexed by the mob's slot on the block, instead of
+ * inside each mob */
+struct stMobChunk {
+    mob pMobs[MOB_CHUNK_LEN];
+    /** Whether each mob is alive */
+    int pIsAlive[MOB_CHUNK_LEN];
+    /** Current health (max can be calculated from the level) */
+    int pHealth[MOB_CHUNK_LEN];
+    /** Current attack power (i.e., how much damage it deals) */
+    int pAtkPower[MOB_CHUNK_LEN];
+    /** Traits */
+    int pTraits[MOB_CHUNK_LEN];
+    /** For how long each mob has been dashing */
+    int pCurDashTimer[MOB_CHUNK_LEN];
+    /** For how long each mob can't be hurt */
+    int pInvulnerableTime[MOB_CHUNK_LEN];
+};
+typedef struct stMobChunk mobChunk;
+
+/** Access one of the mob's hot fields (stored on its block) */
+#define MOB_HOT(pMob, field) ((pMob)->pChunk->field[(pMob)->slot])
+
+/** 'Export' the mob pool struct */
+struct stMobPool {
+    /** Contiguous blocks of mobs, so they are iterated without chasing a
+     * pointer for each one */
+    mobChunk **ppChunks;
+    /** How many chunks were alloc'ed */
+    int chunksLen;
+    /** How many mobs are in use */
+    int used;
+    /** Index of every mob that is still alive */
+    int *pActive;
+    /** How many indices fit on the active list */
+    int activeLen;
+    /** How many mobs are alive */
+    int numActive;
+    /** Index of every dead mob, whose sprite may be reused */
+    int *pFree;
+    /** How many indices fit on the free list */
+    int freeLen;
+    /** How many dead mobs may be reused */
+    int numFree;
+    /** Packed state used to update shadows in batches */
+    shadowBatch batch;
+};
+
+/**
+ * Alloc a new pool of mobs
+ */
+gfmRV mobPool_getNew(mobPool **ppPool) {
     gfmRV rv;
     
-    int sx, sy, w, h;
+    ASSERT(ppPool, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppPool), GFMRV_ARGUMENTS_BAD);
     
-    if (ox == NEG_INF) {
-        *pDist = 1000000;
-        rv = GFMRV_OK;
-        goto __ret;
+    *ppPool = (mobPool*)malloc(sizeof(mobPool));
+    ASSERT(*ppPool, GFMRV_ALLOC_FAILED);
+    
+    memset(*ppPool, 0x0, sizeof(mobPool));
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Free a pool and every mob on it
+ */
+gfmRV mobPool_free(mobPool **ppPool) {
+    gfmRV rv;
+    int i;
+    
+    ASSERT(ppPool, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppPool, GFMRV_ARGUMENTS_BAD);
+    
+    i = 0;
+    while (i < (*ppPool)->chunksLen) {
+        free((*ppPool)->ppChunks[i]);
+        i++;
     }
+    free((*ppPool)->ppChunks);
+    free((*ppPool)->pActive);
+    free((*ppPool)->pFree);
+    free((*ppPool)->batch.ppMobs);
+    free((*ppPool)->batch.pData);
+    free(*ppPool);
+    *ppPool = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
 
-    rv = gfmSprite_getPosition(&sx, &sy, pSelf->pSelf);
-    ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmSprite_getDimensions(&w, &h, pSelf->pSelf);
-    ASSERT(rv == GFMRV_OK, rv);
-    sx += w / 2;
-    sy += h / 2;
+/**
+ * Make sure a list of indices can hold at least one more item
+ */
+static gfmRV mobPool_expandList(int **ppList, int *pLen, int num) {
+    gfmRV rv;
+    
+    if (num >= *pLen) {
+        int *pList, len;
+        
+        len = (*pLen) * 2;
+        if (len == 0) {
+            len = MOB_CHUNK_LEN;
+        }
+        
+        pList = (int*)realloc(*ppList, sizeof(int) * len);
+        ASSERT(pList, GFMRV_ALLOC_FAILED);
+        *ppList = pList;
+        *pLen = len;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Zero a mob (and its hot state) before it's handed out, keeping only its
+ * sprite and hitbox
+ */
+static mob* mobPool_clearMob(mobPool *pPool, int i, gfmSprite *pSelf,
+        gfmObject *pAtk) {
+    mobChunk *pChunk;
+    mob *pMob;
+    int slot;
+    
+    pChunk = pPool->ppChunks[i / MOB_CHUNK_LEN];
+    slot = i % MOB_CHUNK_LEN;
+    pMob = pChunk->pMobs + slot;
+    
+    memset(pMob, 0x0, sizeof(mob));
+    pMob->pSelf = pSelf;
+    pMob->pAtk = pAtk;
+    pMob->pChunk = pChunk;
+    pMob->slot = slot;
+    
+    pChunk->pIsAlive[slot] = 0;
+    pChunk->pHealth[slot] = 0;
+    pChunk->pAtkPower[slot] = 0;
+    pChunk->pTraits[slot] = 0;
+    pChunk->pCurDashTimer[slot] = 0;
+    pChunk->pInvulnerableTime[slot] = 0;
+    
+    return pMob;
+}
 
-    pSelf->distX = sx - ox;
-    pSelf->distY = oy - sy;
+/**
+ * Release every mob; They are all moved to the free list, so their sprites and
+ * hitboxes are reused (in the same order they were first retrieved)
+ */
+gfmRV mobPool_reset(mobPool *pPool) {
+    gfmRV rv;
+    int i;
     
-    *pDist  = 1.5 * (pSelf->distX * pSelf->distX);
-    *pDist += 0.8 * (pSelf->distY * pSelf->distY);
+    ASSERT(pPool, GFMRV_ARGUMENTS_BAD);
+    
+    pPool->numActive = 0;
+    pPool->numFree = 0;
+    // The last slot is pushed first, so the first one is popped first
+    i = pPool->used - 1;
+    while (i >= 0) {
+        mob *pMob;
+        
+        rv = mobPool_expandList(&(pPool->pFree), &(pPool->freeLen),
+                pPool->numFree);
+        ASSERT(rv == GFMRV_OK, rv);
+        pPool->pFree[pPool->numFree] = i;
+        pPool->numFree++;
+        
+        // Park it out of the world (as mob_despawn does), otherwise mobs (and
+        // corpses) from the last run would still be drawn until reused
+        pMob = mobPool_getMob(pPool, i);
+        MOB_HOT(pMob, pIsAlive) = 0;
+        pMob->spawnId = -1;
+        if (pMob->pSelf) {
+            rv = gfmSprite_setVelocity(pMob->pSelf, 0, 0);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = gfmSprite_setPosition(pMob->pSelf, NEG_INF, NEG_INF);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        if (pMob->pAtk) {
+            rv = gfmObject_setPosition(pMob->pAtk, NEG_INF, NEG_INF);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        
+        i--;
+    }
     
     rv = GFMRV_OK;
 __ret:
@@ -178,18 +409,59 @@ __ret:
 }
 
 /**
- * Alloc a new mob
+ * Retrieve an unused mob from the pool and add it to the active list; Dead
+ * mobs are reused first (keeping their sprite and hitbox, so mob_init won't
+ * request new ones), otherwise the pool is expanded as necessary; Mobs are
+ * alloc'ed in chunks, so a mob's address never changes (even after expanding)
+ * 
+ * @param  ppMob The retrieved mob (already zeroed)
+ * @param  pPool The pool
  */
-gfmRV mob_getNew(mob **ppMob) {
+gfmRV mobPool_getNext(mob **ppMob, mobPool *pPool) {
     gfmRV rv;
+    int chunk, i;
     
     ASSERT(ppMob, GFMRV_ARGUMENTS_BAD);
-    ASSERT(!(*ppMob), GFMRV_ARGUMENTS_BAD);
+    ASSERT(pPool, GFMRV_ARGUMENTS_BAD);
+    
+    rv = mobPool_expandList(&(pPool->pActive), &(pPool->activeLen),
+            pPool->numActive);
+    ASSERT(rv == GFMRV_OK, rv);
     
-    *ppMob = (mob*)malloc(sizeof(mob));
-    ASSERT(*ppMob, GFMRV_ALLOC_FAILED);
+    if (pPool->numFree > 0) {
+        mob *pMob;
+        
+        pPool->numFree--;
+        i = pPool->pFree[pPool->numFree];
+        pMob = mobPool_getMob(pPool, i);
+        *ppMob = mobPool_clearMob(pPool, i, pMob->pSelf, pMob->pAtk);
+        
+        pPool->pActive[pPool->numActive] = i;
+        pPool->numActive++;
+        
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    chunk = pPool->used / MOB_CHUNK_LEN;
+    // Expand the pool, if there are no more mobs
+    if (chunk >= pPool->chunksLen) {
+        mobChunk **ppChunks;
+        
+        ppChunks = (mobChunk**)realloc(pPool->ppChunks,
+                sizeof(mobChunk*) * (pPool->chunksLen + 1));
+        ASSERT(ppChunks, GFMRV_ALLOC_FAILED);
+        pPool->ppChunks = ppChunks;
+        
+        ppChunks[chunk] = (mobChunk*)malloc(sizeof(mobChunk));
+        ASSERT(ppChunks[chunk], GFMRV_ALLOC_FAILED);
+        pPool->chunksLen++;
+    }
     
-    memset(*ppMob, 0x0, sizeof(mob));
+    *ppMob = mobPool_clearMob(pPool, pPool->used, 0/*pSelf*/, 0/*pAtk*/);
+    pPool->pActive[pPool->numActive] = pPool->used;
+    pPool->numActive++;
+    pPool->used++;
     
     rv = GFMRV_OK;
 __ret:
@@ -197,27 +469,82 @@ __ret:
 }
 
 /**
- * Free a mob's memory
+ * Get how many mobs are in use
+ */
+int mobPool_getUsed(mobPool *pPool) {
+    return pPool->used;
+}
+
+/**
+ * Get a mob from the pool
+ * 
+ * @param  pPool The pool
+ * @param  i     The mob's index (must be less than mobPool_getUsed)
  */
-gfmRV mob_free(mob **ppMob) {
+mob* mobPool_getMob(mobPool *pPool, int i) {
+    return pPool->ppChunks[i / MOB_CHUNK_LEN]->pMobs + (i % MOB_CHUNK_LEN);
+}
+
+/**
+ * Remove every dead mob from the active list; Its position is filled by the
+ * last active mob, so the list order isn't kept
+ */
+gfmRV mobPool_compact(mobPool *pPool) {
     gfmRV rv;
+    int i;
     
-    ASSERT(ppMob, GFMRV_ARGUMENTS_BAD);
-    ASSERT(*ppMob, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pPool, GFMRV_ARGUMENTS_BAD);
     
-    // TODO Check if anything else should be freed
-    free(*ppMob);
-    *ppMob = 0;
+    // Only the block's alive flags are read (not the mobs themselves)
+    i = 0;
+    while (i < pPool->numActive) {
+        int j;
+        
+        j = pPool->pActive[i];
+        if (pPool->ppChunks[j / MOB_CHUNK_LEN]->pIsAlive[j % MOB_CHUNK_LEN]) {
+            i++;
+            continue;
+        }
+        
+        rv = mobPool_expandList(&(pPool->pFree), &(pPool->freeLen),
+                pPool->numFree);
+        ASSERT(rv == GFMRV_OK, rv);
+        pPool->pFree[pPool->numFree] = pPool->pActive[i];
+        pPool->numFree++;
+        
+        // Don't increase the index, since another mob was moved into it
+        pPool->numActive--;
+        pPool->pActive[i] = pPool->pActive[pPool->numActive];
+    }
     
     rv = GFMRV_OK;
 __ret:
     return rv;
 }
 
+/**
+ * Get how many mobs are alive
+ */
+int mobPool_getActiveCount(mobPool *pPool) {
+    return pPool->numActive;
+}
+
+/**
+ * Get a mob from the active list
+ * 
+ * @param  pPool The pool
+ * @param  i     Index on the active list (must be less than
+ *               mobPool_getActiveCount)
+ */
+mob* mobPool_getActive(mobPool *pPool, int i) {
+    return mobPool_getMob(pPool, pPool->pActive[i]);
+}
+
 /**
  * Initializa a mob; To ease memory management, it doesn't alloc memory;
  * Instead, it used objects from the game's array (which are cleaned when the
- * game exits)
+ * game exits); If the mob was recycled from the pool, its previous sprite and
+ * hitbox are reused
  * 
  * @param  pMob  The mob
  * @param  pGame The game's global contex
@@ -227,8 +554,8 @@ __ret:
 gfmRV mob_init(mob *pMob, gameCtx *pGame, int type, int level) {
     gfmRV rv;
     gfmSprite *pSpr;
-    gfmObject *pObj1, *pObj2;
-    int height, offX, offY, scanWidth, scanHeight, width;
+    gfmObject *pObj1;
+    int height, offX, offY, width;
     
     ASSERT(pMob, GFMRV_ARGUMENTS_BAD);
     ASSERT(pGame, GFMRV_ARGUMENTS_BAD);
@@ -237,21 +564,17 @@ gfmRV mob_init(mob *pMob, gameCtx *pGame, int type, int level) {
             GFMRV_ARGUMENTS_BAD);
     
     // Retrieve all needed objects
-    pSpr = 0;
-    pObj1 = 0;
-    pObj2 = 0;
+    pSpr = pMob->pSelf;
+    pObj1 = pMob->pAtk;
     
     
     width = 12;
     height = 4;
     offX = -10;
     offY = -28;
-    if (type != wall) {
+    if (type != wall && !pObj1) {
         gfmGenArr_getNextRef(gfmObject, pGame->pObjs, 1, pObj1, gfmObject_getNew);
         gfmGenArr_push(pGame->pObjs);
-        
-        gfmGenArr_getNextRef(gfmObject, pGame->pObjs, 1, pObj2, gfmObject_getNew);
-        gfmGenArr_push(pGame->pObjs);
     }
     else {
         width = 32;
@@ -259,11 +582,18 @@ gfmRV mob_init(mob *pMob, gameCtx *pGame, int type, int level) {
         height = 12;
         offY = -24;
     }
-    rv = gfmGroup_recycle(&pSpr, pGame->pRender);
-    ASSERT(rv == GFMRV_OK, rv);
+    if (pSpr) {
+        // Clean whatever was set by the previous mob
+        rv = gfmSprite_resetAnimations(pSpr);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = gfmSprite_setMovable(pSpr);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    else {
+        rv = gfmGroup_recycle(&pSpr, pGame->pRender);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
     
-    scanWidth = 64;
-    scanHeight = 24;
     if (pSpr) {
         pMob->pSelf = pSpr;
         rv = gfmSprite_init(pMob->pSelf, 0/*x*/, 0/*y*/, width, height,
@@ -276,12 +606,6 @@ gfmRV mob_init(mob *pMob, gameCtx *pGame, int type, int level) {
                 4/*height*/, pMob/*pChild*/, atk);
         ASSERT(rv == GFMRV_OK, rv);
     }
-    if (pObj2) {
-        pMob->pScan = pObj2;
-        rv = gfmObject_init(pMob->pScan, -100/*x*/, -100/*y*/, scanWidth,
-                scanHeight, pMob/*pChild*/, scan);
-        ASSERT(rv == GFMRV_OK, rv);
-    }
     
     if (type == wall) {
         rv = gfmSprite_setFixed(pSpr);
@@ -290,7 +614,9 @@ gfmRV mob_init(mob *pMob, gameCtx *pGame, int type, int level) {
     
     pMob->level = level;
     pMob->type = type;
-    pMob->isAlive = 1;
+    MOB_HOT(pMob, pIsAlive) = 1;
+    pMob->spawnId = -1;
+    pMob->hitPower = -1;
     pMob->plLastPosX = NEG_INF;
     pMob->plLastPosY = NEG_INF;
     
@@ -335,8 +661,8 @@ gfmRV mob_setAnimations(mob *pMob, int subtype) {
             pMob->horSpeed = 48;
             pMob->verSpeed = 32;
             
-            pMob->atkPower = 1;
-            pMob->health = 10;
+            MOB_HOT(pMob, pAtkPower) = 1;
+            MOB_HOT(pMob, pHealth) = 10;
         } break;
         case npc: {
         } break;
@@ -350,28 +676,30 @@ gfmRV mob_setAnimations(mob *pMob, int subtype) {
             
             switch (subtype) {
                 case EN_SLIME: {
-                    pMob->atkPower = 0;
-                    pMob->health = 2;
+                    MOB_HOT(pMob, pAtkPower) = 0;
+                    MOB_HOT(pMob, pHealth) = 2;
                 } break;
                 case EN_ANGRYSLIME: {
-                    pMob->atkPower = 2;
-                    pMob->health = 3;
+                    MOB_HOT(pMob, pAtkPower) = 2;
+                    MOB_HOT(pMob, pHealth) = 3;
                 } break;
                 case EN_SWARMSLIME: {
-                    pMob->atkPower = 1;
-                    pMob->health = 1;
+                    MOB_HOT(pMob, pAtkPower) = 1;
+                    MOB_HOT(pMob, pHealth) = 1;
                 } break;
                 default: ASSERT(0, GFMRV_FUNCTION_NOT_IMPLEMENTED);
             }
         } break;
         case wall: {
-            pMob->health = 2;
+            MOB_HOT(pMob, pHealth) = 2;
         } break;
         default: ASSERT(0, GFMRV_INTERNAL_ERROR);
     }
     
-    pMob->atkPower = pMob->atkPower + pMob->atkPower * (pMob->level - 1) * 0.5;
-    pMob->health = pMob->health + pMob->health * (pMob->level - 1) * 0.5;
+    MOB_HOT(pMob, pAtkPower) = MOB_HOT(pMob, pAtkPower) +
+            MOB_HOT(pMob, pAtkPower) * (pMob->level - 1) * 0.5;
+    MOB_HOT(pMob, pHealth) = MOB_HOT(pMob, pHealth) +
+            MOB_HOT(pMob, pHealth) * (pMob->level - 1) * 0.5;
     
     rv = gfmSprite_addAnimations(pMob->pSelf, pData, len);
 __ret:
@@ -391,8 +719,54 @@ __ret:
     return rv;
 }
 
+gfmRV mob_getPosition(int *pX, int *pY, mob *pMob) {
+    return gfmSprite_getPosition(pX, pY, pMob->pSelf);
+}
+
+gfmRV mob_getDimensions(int *pWidth, int *pHeight, mob *pMob) {
+    return gfmSprite_getDimensions(pWidth, pHeight, pMob->pSelf);
+}
+
+gfmRV mob_setSpawnId(mob *pMob, int spawnId) {
+    pMob->spawnId = spawnId;
+    return GFMRV_OK;
+}
+
+int mob_getSpawnId(mob *pMob) {
+    return pMob->spawnId;
+}
+
+/**
+ * Remove a mob from the world without killing it (e.g., because it's too far
+ * from the camera); Its sprite is hidden until it's reused by another mob
+ */
+gfmRV mob_despawn(mob *pMob, gameCtx *pGame) {
+    gfmRV rv;
+    
+    if (pMob->type == wall && MOB_HOT(pMob, pIsAlive)) {
+        rv = collide_removeStaticSpr(pMob->pSelf, pGame);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    
+    MOB_HOT(pMob, pIsAlive) = 0;
+    pMob->spawnId = -1;
+    
+    rv = gfmSprite_setVelocity(pMob->pSelf, 0, 0);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmSprite_setPosition(pMob->pSelf, NEG_INF, NEG_INF);
+    ASSERT(rv == GFMRV_OK, rv);
+    if (pMob->pAtk) {
+        rv = gfmObject_setPosition(pMob->pAtk, NEG_INF, NEG_INF);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
 gfmRV mob_setTraits(mob *pMob, int traits) {
-    pMob->traits = traits;
+    MOB_HOT(pMob, pTraits) = traits;
     return GFMRV_OK;
 }
 
@@ -401,136 +775,91 @@ gfmRV mob_setDist(mob *pMob, int dist) {
     return GFMRV_OK;
 }
 
-gfmRV mob_update(mob *pMob, gameCtx *pGame) {
-    double vx, vy;
+/**
+ * Add the mob to the static collision layer, if it never moves (i.e., walls)
+ */
+gfmRV mob_populateStatic(mob *pMob, gameCtx *pGame) {
     gfmRV rv;
-    int doAttack, move;
     
-    if (!pMob->isAlive) {
-        rv = GFMRV_OK;
-        goto __ret;
+    rv = GFMRV_OK;
+    if (pMob->type == wall && MOB_HOT(pMob, pIsAlive)) {
+        rv = collide_addStaticSpr(pMob->pSelf, pGame);
     }
     
-    doAttack = 0;
+    return rv;
+}
+
+/**
+ * Add the mob to the view layer, so others may find it
+ */
+gfmRV mob_populateView(mob *pMob, gameCtx *pGame) {
+    gfmRV rv;
     
-    //==========================================================================
-    // Check type and 'advance the AI'
-    //
-    move = MOVE_STAND;
-    switch (pMob->type) {
-        case player: {
-            // Set player's horizontal movement
-            if (pGame->num_right >= 2 &&
-                    (pGame->state_right & gfmInput_pressed)) {
-                move = MOVE_DASH_RIGHT;
-            }
-            else if (pGame->num_left >= 2 &&
-                    (pGame->state_left & gfmInput_pressed)) {
-                move = MOVE_DASH_LEFT;
-            }
-            else if (pGame->state_right & gfmInput_pressed) {
-                move = MOVE_RIGHT;
-            }
-            else if (pGame->state_left & gfmInput_pressed) {
-                move = MOVE_LEFT;
-            }
-            // Set player's horizontal movement
-            if (pGame->num_up >= 2 &&
-                    (pGame->state_up & gfmInput_pressed)) {
-                move |= MOVE_DASH_UP;
-            }
-            else if (pGame->num_down >= 2 &&
-                    (pGame->state_down & gfmInput_pressed)) {
-                move |= MOVE_DASH_DOWN;
-            }
-            else if (pGame->state_up & gfmInput_pressed) {
-                move |= MOVE_UP;
-            }
-            else if (pGame->state_down & gfmInput_pressed) {
-                move |= MOVE_DOWN;
-            }
-            // Set player's attack
-            if ((pGame->state_atk & gfmInput_justPressed) ==
-                    gfmInput_justPressed) {
-                doAttack = 1;
-            }
-        } break; // player
-        case shadow: {
-            if (((pMob->traits & TR_SWARMER) && pMob->nearbyShadowCount >= 3) ||
-                    (pMob->traits & TR_ANGRY)) {
-                int dist;
-                
-                rv = mob_getDist(&dist, pMob, pMob->plLastPosX,
-                        pMob->plLastPosY);
-                ASSERT(rv == GFMRV_OK, rv);
-                
-                if (pMob->distY > -4 && pMob->distY < 4 && (
-                        (pMob->distX < -8 && pMob->distX > -20) ||
-                        (pMob->distX > 8 && pMob->distX < 20))) {
-                    // Attack if the player is close
-                    doAttack = 1;
-                }
-                if (!doAttack && dist <= pMob->dist) {
-                    if (pMob->distX < -2) {
-                        move |= MOVE_RIGHT;
-                    }
-                    else if (pMob->distX > 2) {
-                        move |= MOVE_LEFT;
-                    }
-                    if (pMob->distY < -2) {
-                        move |= MOVE_UP;
-                    }
-                    else if (pMob->distY > 2) {
-                        move |= MOVE_DOWN;
-                    }
-                } // if dist
-            } // if angry
-            else if (((pMob->traits & TR_SWARMER) &&
-                    pMob->nearbyShadowCount < 3) || (pMob->traits & TR_COWARD)) {
-                int dist;
-                
-                rv = mob_getDist(&dist, pMob, pMob->plLastPosX,
-                        pMob->plLastPosY);
-                ASSERT(rv == GFMRV_OK, rv);
-                
-                if (dist <= pMob->dist) {
-                    if (pMob->distX < -2) {
-                        move |= MOVE_LEFT;
-                    }
-                    else if (pMob->distX > 2) {
-                        move |= MOVE_RIGHT;
-                    }
-                    if (pMob->distY < -2) {
-                        move |= MOVE_DOWN;
-                    }
-                    else if (pMob->distY > 2) {
-                        move |= MOVE_UP;
-                    }
-                } // if dist
-            } // if coward
-        } break; // shadow
-        case npc: {
-        } break; // npc
-        case wall: {
-            move = 0;
-        } break; // wall
-        default: ASSERT(0, GFMRV_INTERNAL_ERROR);
+    rv = GFMRV_OK;
+    if ((pMob->type == player || pMob->type == shadow) &&
+            MOB_HOT(pMob, pIsAlive)) {
+        rv = collide_addViewSpr(pMob->pSelf, pGame);
     }
-    //= ( AI ) =================================================================
     
-    if (pMob->curDashTimer <= 0) {
+    return rv;
+}
+
+/**
+ * Look for every mob around this one (i.e., the player and other shadows)
+ */
+static gfmRV mob_scan(mob *pMob, gameCtx *pGame) {
+    gfmRV rv;
+    int h, i, num, w, x, y;
+    mob **ppMobs;
+    
+    rv = gfmSprite_getPosition(&x, &y, pMob->pSelf);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmSprite_getDimensions(&w, &h, pMob->pSelf);
+    ASSERT(rv == GFMRV_OK, rv);
+    // Center the scan area on the sprite
+    x += w / 2 - SCAN_WIDTH / 2;
+    y += h / 2 - SCAN_HEIGHT / 2;
+    
+    rv = collide_queryView(&ppMobs, &num, pGame, x, y, SCAN_WIDTH,
+            SCAN_HEIGHT);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    pMob->nearbyShadowCount = 0;
+    i = 0;
+    while (i < num) {
+        if (ppMobs[i] != pMob) {
+            rv = mob_setOnView(pMob, ppMobs[i]);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        i++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Apply a mob's decision (i.e., its movement and whether it attacks) to its
+ * sprite, and advance its timers and animation
+ */
+static gfmRV mob_act(mob *pMob, gameCtx *pGame, int move, int doAttack) {
+    double vx, vy;
+    gfmRV rv;
+    
+    if (MOB_HOT(pMob, pCurDashTimer) <= 0) {
         if (move & MOVE_DASH_LEFT) {
             vx = -pMob->dashHorSpeed;
             // Set dash timer
             if (!(pMob->lastMove & MOVE_DASH_LEFT)) {
-                pMob->curDashTimer += pMob->dashTime;
+                MOB_HOT(pMob, pCurDashTimer) += pMob->dashTime;
             }
         }
         else if (move & MOVE_DASH_RIGHT) {
             vx = pMob->dashHorSpeed;
             // Set dash timer
             if (!(pMob->lastMove & MOVE_DASH_RIGHT)) {
-                pMob->curDashTimer += pMob->dashTime;
+                MOB_HOT(pMob, pCurDashTimer) += pMob->dashTime;
             }
         }
         else if (move & MOVE_LEFT) {
@@ -547,14 +876,14 @@ gfmRV mob_update(mob *pMob, gameCtx *pGame) {
             vy = -pMob->dashVerSpeed;
             // Set dash timer
             if (!(pMob->lastMove & MOVE_DASH_UP)) {
-                pMob->curDashTimer += pMob->dashTime;
+                MOB_HOT(pMob, pCurDashTimer) += pMob->dashTime;
             }
         }
         else if (move & MOVE_DASH_DOWN) {
             vy = pMob->dashVerSpeed;
             // Set dash timer
             if (!(pMob->lastMove & MOVE_DASH_DOWN)) {
-                pMob->curDashTimer += pMob->dashTime;
+                MOB_HOT(pMob, pCurDashTimer) += pMob->dashTime;
             }
         }
         else if (move & MOVE_UP) {
@@ -567,7 +896,8 @@ gfmRV mob_update(mob *pMob, gameCtx *pGame) {
             vy = 0;
         }
         
-        if (doAttack == 0 && (!pMob->isHurt || pMob->curDashTimer > 0)) {
+        if (doAttack == 0 && (!pMob->isHurt ||
+                MOB_HOT(pMob, pCurDashTimer) > 0)) {
             if (pMob->type != player) {
                 if (vx != 0) {
                     int rng;
@@ -614,21 +944,21 @@ gfmRV mob_update(mob *pMob, gameCtx *pGame) {
         ASSERT(rv == GFMRV_OK, rv);
     }
     
-    if (pMob->curDashTimer > 0) {
+    if (MOB_HOT(pMob, pCurDashTimer) > 0) {
         int elapsed;
         
         rv = gfm_getElapsedTime(&elapsed, pGame->pCtx);
         ASSERT(rv == GFMRV_OK, rv);
         
-        pMob->curDashTimer -= elapsed;
+        MOB_HOT(pMob, pCurDashTimer) -= elapsed;
     }
-    if (pMob->invulnerableTime > 0) {
+    if (MOB_HOT(pMob, pInvulnerableTime) > 0) {
         int elapsed;
         
         rv = gfm_getElapsedTime(&elapsed, pGame->pCtx);
         ASSERT(rv == GFMRV_OK, rv);
         
-        pMob->invulnerableTime -= elapsed;
+        MOB_HOT(pMob, pInvulnerableTime) -= elapsed;
     }
     
     // Set the animation
@@ -638,15 +968,20 @@ gfmRV mob_update(mob *pMob, gameCtx *pGame) {
         ASSERT(rv == GFMRV_TRUE || rv == GFMRV_FALSE, rv);
         
         if (rv == GFMRV_TRUE) {
-            if (pMob->health > 0) {
+            if (MOB_HOT(pMob, pHealth) > 0) {
                 pMob->isHurt = 0;
             }
             else {
                 // Kill it!
-                pMob->isAlive = 0;
+                MOB_HOT(pMob, pIsAlive) = 0;
                 
                 rv = gfmSprite_setVelocity(pMob->pSelf, 0, 0);
                 ASSERT(rv == GFMRV_OK, rv);
+                
+                if (pMob->type == wall) {
+                    rv = collide_removeStaticSpr(pMob->pSelf, pGame);
+                    ASSERT(rv == GFMRV_OK, rv);
+                }
             }
         }
         // Set to OK, otherwise the ASSERT fail
@@ -670,19 +1005,397 @@ gfmRV mob_update(mob *pMob, gameCtx *pGame) {
     }
     ASSERT(rv == GFMRV_OK, rv);
     
-    // Reset those, so they can be fully calculated until next frame
-    pMob->nearbyShadowCount = 0;
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Point every one of a batch's arrays into its buffers
+ * 
+ * @param  pBatch The batch
+ * @param  ppMobs Buffer with room for len * 2 mobs
+ * @param  pData  Buffer with room for len * SHADOW_BATCH_INTS integers
+ * @param  len    How many shadows fit on the batch
+ */
+static void mob_setBatchBuffers(shadowBatch *pBatch, mob **ppMobs, int *pData,
+        int len) {
+    pBatch->ppMobs = ppMobs;
+    pBatch->ppTmp = ppMobs + len;
+    pBatch->pData = pData;
+    pBatch->pMode = pData;
+    pBatch->pX = pData + len;
+    pBatch->pY = pData + len * 2;
+    pBatch->pTgtX = pData + len * 3;
+    pBatch->pTgtY = pData + len * 4;
+    pBatch->pMaxDist = pData + len * 5;
+    pBatch->pDirX = pData + len * 6;
+    pBatch->pDirY = pData + len * 7;
+    pBatch->pAttack = pData + len * 8;
+    pBatch->len = len;
+}
+
+/**
+ * Decide where a range of a batch's shadows go; Only reads the world (and the
+ * shared flowfield) and only writes to the range, so ranges may run on
+ * different threads
+ *
+ * @param  pCtx  The batch's shadowJob
+ * @param  first First shadow on the range
+ * @param  last  Shadow after the last one on the range
+ */
+static gfmRV mob_decideShadows(void *pCtx, int first, int last) {
+    gfmRV rv;
+    shadowBatch *pBatch;
+    shadowJob *pJob;
+    int end, i;
+    
+    pJob = (shadowJob*)pCtx;
+    pBatch = pJob->pBatch;
+    
+    //==========================================================================
+    // Distance to the player's last known position (weighted 1.5:0.8, scaled
+    // by 10 to stay on integers) and the direction straight to it
+    //
+    i = first;
+    while (i < last) {
+        int dx, dy, inRange;
+        
+        dx = pBatch->pX[i] - pBatch->pTgtX[i];
+        dy = pBatch->pTgtY[i] - pBatch->pY[i];
+        inRange = (15 * dx * dx + 8 * dy * dy <= 10 * pBatch->pMaxDist[i]);
+        
+        pBatch->pDirX[i] = inRange * ((dx < -2) - (dx > 2));
+        pBatch->pDirY[i] = inRange * ((dy > 2) - (dy < -2));
+        pBatch->pAttack[i] = (dy > -4) & (dy < 4) &
+                (((dx < -8) & (dx > -20)) | ((dx > 8) & (dx < 20)));
+        
+        i++;
+    }
+    
+    // Chasing shadows stop to attack
+    i = first;
+    end = (last < pBatch->numChase) ? last : pBatch->numChase;
+    while (i < end) {
+        pBatch->pDirX[i] *= 1 - pBatch->pAttack[i];
+        pBatch->pDirY[i] *= 1 - pBatch->pAttack[i];
+        
+        i++;
+    }
+    // Fleeing shadows go the other way (and never attack)
+    end = pBatch->numChase + pBatch->numFlee;
+    end = (last < end) ? last : end;
+    while (i < end) {
+        pBatch->pDirX[i] = -pBatch->pDirX[i];
+        pBatch->pDirY[i] = -pBatch->pDirY[i];
+        pBatch->pAttack[i] = 0;
+        
+        i++;
+    }
+    // Idle shadows do nothing
+    while (i < last) {
+        pBatch->pDirX[i] = 0;
+        pBatch->pDirY[i] = 0;
+        pBatch->pAttack[i] = 0;
+        
+        i++;
+    }
+    //= ( Distance ) ===========================================================
+    
+    //==========================================================================
+    // Follow the flowfield (which goes around walls), if it leads anywhere;
+    // Otherwise, keep going straight to the player
+    //
+    i = first;
+    end = pBatch->numChase + pBatch->numFlee;
+    end = (last < end) ? last : end;
+    while (i < end) {
+        int dirX, dirY;
+        
+        if (pBatch->pDirX[i] != 0 || pBatch->pDirY[i] != 0) {
+            rv = flowfield_getDirection(&dirX, &dirY, pJob->pGame->pFlow,
+                    pBatch->pX[i], pBatch->pY[i],
+                    i >= pBatch->numChase/*isFleeing*/);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            if (dirX != 0 || dirY != 0) {
+                pBatch->pDirX[i] = dirX;
+                pBatch->pDirY[i] = dirY;
+            }
+        }
+        
+        i++;
+    }
+    //= ( Steer ) ==============================================================
     
     rv = GFMRV_OK;
 __ret:
     return rv;
 }
+
+/**
+ * Update a batch of shadows; Each stage of the AI goes through every shadow
+ * before the next one starts, over packed arrays: first, every shadow looks
+ * around and is classified by its behaviour (serially, since it queries the
+ * view layer); then, every shadow decides where to go (in parallel, see
+ * mob_decideShadows); and, at last, every decision is applied to the sprites
+ * (serially, since it writes to the sprites and plays sounds)
+ *
+ * @param  pBatch  Packed state (with room for at least num shadows)
+ * @param  ppMobs  The mobs (anything but a living shadow is skipped)
+ * @param  num     How many mobs there are
+ * @param  pGame   The game's context
+ */
+static gfmRV mob_runShadowBatch(shadowBatch *pBatch, mob **ppMobs, int num,
+        gameCtx *pGame) {
+    gfmRV rv;
+    int chase, end, flee, i, numChase, numFlee;
+    shadowJob job;
+    
+    //==========================================================================
+    // Look around and classify every shadow (chasing ones first, then the ones
+    // fleeing and then idle ones)
+    //
+    numChase = 0;
+    numFlee = 0;
+    pBatch->num = 0;
+    i = 0;
+    while (i < num) {
+        mob *pMob;
+        
+        pMob = ppMobs[i];
+        i++;
+        if (pMob->type != shadow || !MOB_HOT(pMob, pIsAlive)) {
+            continue;
+        }
+        
+        rv = mob_scan(pMob, pGame);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        if (((MOB_HOT(pMob, pTraits) & TR_SWARMER) &&
+                pMob->nearbyShadowCount >= 3) ||
+                (MOB_HOT(pMob, pTraits) & TR_ANGRY)) {
+            pBatch->pMode[pBatch->num] = SHADOW_CHASE;
+            numChase++;
+        }
+        else if (MOB_HOT(pMob, pTraits) & (TR_SWARMER | TR_COWARD)) {
+            pBatch->pMode[pBatch->num] = SHADOW_FLEE;
+            numFlee++;
+        }
+        else {
+            pBatch->pMode[pBatch->num] = SHADOW_IDLE;
+        }
+        pBatch->ppTmp[pBatch->num] = pMob;
+        pBatch->num++;
+    }
+    
+    chase = 0;
+    flee = numChase;
+    end = numChase + numFlee;
+    i = 0;
+    while (i < pBatch->num) {
+        mob *pMob;
+        int h, j, w, x, y;
+        
+        pMob = pBatch->ppTmp[i];
+        switch (pBatch->pMode[i]) {
+            case SHADOW_CHASE: j = chase++; break;
+            case SHADOW_FLEE: j = flee++; break;
+            default: j = end++;
+        }
+        
+        rv = gfmSprite_getPosition(&x, &y, pMob->pSelf);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = gfmSprite_getDimensions(&w, &h, pMob->pSelf);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        pBatch->ppMobs[j] = pMob;
+        pBatch->pX[j] = x + w / 2;
+        pBatch->pY[j] = y + h / 2;
+        if (pMob->plLastPosX == NEG_INF) {
+            // Never saw the player, so it's never in range
+            pBatch->pTgtX[j] = pBatch->pX[j];
+            pBatch->pTgtY[j] = pBatch->pY[j];
+            pBatch->pMaxDist[j] = -1;
+        }
+        else {
+            pBatch->pTgtX[j] = pMob->plLastPosX;
+            pBatch->pTgtY[j] = pMob->plLastPosY;
+            pBatch->pMaxDist[j] = pMob->dist;
+        }
+        
+        i++;
+    }
+    //= ( Classify ) ===========================================================
     
+    //==========================================================================
+    // Decide where every shadow goes (split between every thread)
+    //
+    pBatch->numChase = numChase;
+    pBatch->numFlee = numFlee;
+    job.pBatch = pBatch;
+    job.pGame = pGame;
+    rv = jobs_parallelFor(pGame->pJobs, mob_decideShadows, &job, pBatch->num,
+            SHADOW_GRAIN);
+    ASSERT(rv == GFMRV_OK, rv);
+    //= ( Decide ) =============================================================
+    
+    //==========================================================================
+    // Apply every decision
+    //
+    i = 0;
+    while (i < pBatch->num) {
+        int move;
+        
+        move = MOVE_STAND;
+        if (pBatch->pDirX[i] < 0) {
+            move |= MOVE_LEFT;
+        }
+        else if (pBatch->pDirX[i] > 0) {
+            move |= MOVE_RIGHT;
+        }
+        if (pBatch->pDirY[i] < 0) {
+            move |= MOVE_UP;
+        }
+        else if (pBatch->pDirY[i] > 0) {
+            move |= MOVE_DOWN;
+        }
+        
+        rv = mob_act(pBatch->ppMobs[i], pGame, move, pBatch->pAttack[i]);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        i++;
+    }
+    //= ( Apply ) ==============================================================
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Update every living shadow on a list in a single batch; Anything else on the
+ * list is skipped (and should be updated by mob_update)
+ * 
+ * @param  pPool  The pool (which keeps the batch's memory)
+ * @param  ppMobs The mobs
+ * @param  num    How many mobs there are
+ * @param  pGame  The game's context
+ */
+gfmRV mobPool_updateShadows(mobPool *pPool, mob **ppMobs, int num,
+        gameCtx *pGame) {
+    gfmRV rv;
+    shadowBatch *pBatch;
+    
+    ASSERT(pPool, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pGame, GFMRV_ARGUMENTS_BAD);
+    
+    pBatch = &(pPool->batch);
+    if (num > pBatch->len) {
+        int *pTmp;
+        mob **ppTmp;
+        
+        pTmp = (int*)realloc(pBatch->pData, sizeof(int) * num *
+                SHADOW_BATCH_INTS);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        ppTmp = (mob**)realloc(pBatch->ppMobs, sizeof(mob*) * num * 2);
+        ASSERT(ppTmp, GFMRV_ALLOC_FAILED);
+        
+        mob_setBatchBuffers(pBatch, ppTmp, pTmp, num);
+    }
+    
+    rv = mob_runShadowBatch(pBatch, ppMobs, num, pGame);
+__ret:
+    return rv;
+}
+
+gfmRV mob_update(mob *pMob, gameCtx *pGame) {
+    gfmRV rv;
+    int doAttack, move;
+    
+    if (!MOB_HOT(pMob, pIsAlive)) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    // A lone shadow is updated as a batch of one
+    if (pMob->type == shadow) {
+        shadowBatch batch;
+        mob *ppBuf[2];
+        int pData[SHADOW_BATCH_INTS];
+        
+        mob_setBatchBuffers(&batch, ppBuf, pData, 1);
+        rv = mob_runShadowBatch(&batch, &pMob, 1, pGame);
+        goto __ret;
+    }
+    
+    doAttack = 0;
+    
+    //==========================================================================
+    // Check type and 'advance the AI'
+    //
+    move = MOVE_STAND;
+    switch (pMob->type) {
+        case player: {
+            // Set player's horizontal movement
+            if (pGame->num_right >= 2 &&
+                    (pGame->state_right & gfmInput_pressed)) {
+                move = MOVE_DASH_RIGHT;
+            }
+            else if (pGame->num_left >= 2 &&
+                    (pGame->state_left & gfmInput_pressed)) {
+                move = MOVE_DASH_LEFT;
+            }
+            else if (pGame->state_right & gfmInput_pressed) {
+                move = MOVE_RIGHT;
+            }
+            else if (pGame->state_left & gfmInput_pressed) {
+                move = MOVE_LEFT;
+            }
+            // Set player's horizontal movement
+            if (pGame->num_up >= 2 &&
+                    (pGame->state_up & gfmInput_pressed)) {
+                move |= MOVE_DASH_UP;
+            }
+            else if (pGame->num_down >= 2 &&
+                    (pGame->state_down & gfmInput_pressed)) {
+                move |= MOVE_DASH_DOWN;
+            }
+            else if (pGame->state_up & gfmInput_pressed) {
+                move |= MOVE_UP;
+            }
+            else if (pGame->state_down & gfmInput_pressed) {
+                move |= MOVE_DOWN;
+            }
+            // Set player's attack
+            if ((pGame->state_atk & gfmInput_justPressed) ==
+                    gfmInput_justPressed) {
+                doAttack = 1;
+            }
+        } break; // player
+        case npc: {
+        } break; // npc
+        case wall: {
+            move = 0;
+        } break; // wall
+        default: ASSERT(0, GFMRV_INTERNAL_ERROR);
+    }
+    //= ( AI ) =================================================================
+    
+    rv = mob_act(pMob, pGame, move, doAttack);
+__ret:
+    return rv;
+}
+
+gfmRV mob_updateSprite(mob *pMob, gameCtx *pGame) {
+    return gfmSprite_update(pMob->pSelf, pGame->pCtx);
+}
+
 gfmRV mob_postUpdate(mob *pMob, gameCtx *pGame) {
     gfmRV rv;
     int h, w, x, y;
     
-    if (!pMob->isAlive) {
+    if (!MOB_HOT(pMob, pIsAlive)) {
         rv = GFMRV_OK;
         goto __ret;
     }
@@ -724,23 +1437,13 @@ gfmRV mob_postUpdate(mob *pMob, gameCtx *pGame) {
         }
     } // If is attacking (set hitbox)
     
-    // Set the scan position
-    if (pMob->type != wall) {
-        rv = gfmObject_getDimensions(&w, &h, pMob->pScan);
-        ASSERT(rv == GFMRV_OK, rv);
-        rv = gfmObject_setPosition(pMob->pScan, x - w / 2, y - h / 2);
-        ASSERT(rv == GFMRV_OK, rv);
-    }
-    
     // Add it to the quadtree
     if (pMob->type != wall) {
-        rv = collide_obj(pMob->pScan, pGame);
-        ASSERT(rv == GFMRV_OK, rv);
         rv = collide_obj(pMob->pAtk, pGame);
         ASSERT(rv == GFMRV_OK, rv);
+        rv = collide_spr(pMob->pSelf, pGame);
+        ASSERT(rv == GFMRV_OK, rv);
     }
-    rv = collide_spr(pMob->pSelf, pGame);
-    ASSERT(rv == GFMRV_OK, rv);
     
     // If it's the player, center the camera on it
     if (pMob->type == player) {
@@ -761,8 +1464,35 @@ gfmRV mob_draw(mob *pMob, gameCtx *pGame) {
     return gfmSprite_draw(pMob->pSelf, pGame->pCtx);
 }
 
+/**
+ * Check whether any of the mob's frame is within a rectangle
+ */
+gfmRV mob_isOnCamera(mob *pMob, int x, int y, int width, int height) {
+    gfmRV rv;
+    int offX, offY, sprX, sprY;
+    
+    rv = gfmSprite_getPosition(&sprX, &sprY, pMob->pSelf);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmSprite_getOffset(&offX, &offY, pMob->pSelf);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Every mob is drawn from the 32x32 spriteset
+    sprX += offX;
+    sprY += offY;
+    if (sprX + 32 > x && sprY + 32 > y && sprX < x + width &&
+            sprY < y + height) {
+        rv = GFMRV_TRUE;
+    }
+    else {
+        rv = GFMRV_FALSE;
+    }
+__ret:
+    return rv;
+}
+
 gfmRV mob_isVulnerable(mob *pMob) {
-    if (pMob->invulnerableTime <= 0 && pMob->curDashTimer <= 0) {
+    if (MOB_HOT(pMob, pInvulnerableTime) <= 0 &&
+            MOB_HOT(pMob, pCurDashTimer) <= 0) {
         return GFMRV_TRUE;
     }
     return GFMRV_FALSE;
@@ -797,17 +1527,43 @@ __ret:
     return rv;
 }
 
-/** pSelf attacks pMob */
-gfmRV mob_attack(mob *pSelf, mob *pMob, gameCtx *pGame) {
+/**
+ * Record that pSelf hit pMob on this frame; Only the strongest hit is kept, and
+ * it's only applied by mob_resolveHits
+ * 
+ * @return GFMRV_TRUE (if it's the first hit on pMob this frame), GFMRV_FALSE
+ */
+gfmRV mob_addHit(mob *pSelf, mob *pMob) {
     gfmRV rv;
     
-    if (mob_isVulnerable(pMob) == GFMRV_TRUE) {
-        pMob->health -= pSelf->atkPower;
+    rv = (pMob->hitPower < 0) ? GFMRV_TRUE : GFMRV_FALSE;
+    if (MOB_HOT(pSelf, pAtkPower) > pMob->hitPower) {
+        pMob->hitPower = MOB_HOT(pSelf, pAtkPower);
+    }
+    
+    return rv;
+}
+
+/**
+ * Apply the strongest hit recorded on a mob (if any) as a single attack (i.e.,
+ * a single animation change and sound)
+ */
+gfmRV mob_resolveHits(mob *pMob, gameCtx *pGame) {
+    gfmRV rv;
+    int height, power, width, x, y;
+    
+    power = pMob->hitPower;
+    pMob->hitPower = -1;
+    
+    // Hits without any power still hurt the mob (i.e., stop it and make it
+    // invulnerable for a while), they just don't change its health
+    if (power >= 0 && mob_isVulnerable(pMob) == GFMRV_TRUE) {
+        MOB_HOT(pMob, pHealth) -= power;
         pMob->isHurt = 1;
         
-        pMob->invulnerableTime = 500;
+        MOB_HOT(pMob, pInvulnerableTime) = 500;
         
-        if (pMob->health > 0) {
+        if (MOB_HOT(pMob, pHealth) > 0) {
             rv = gfmSprite_playAnimation(pMob->pSelf, ANIM_HIT);
             ASSERT(rv == GFMRV_OK, rv);
             
@@ -815,15 +1571,15 @@ gfmRV mob_attack(mob *pSelf, mob *pMob, gameCtx *pGame) {
             ASSERT(rv == GFMRV_OK, rv);
             
             if (pMob->type == wall) {
-                rv = gfm_playAudio(0, pGame->pCtx, pGame->wall_hit, 0.6);
+                rv = sfx_play(pGame->pSfx, SFX_WALL_HIT, 0.6);
                 ASSERT(rv == GFMRV_OK, rv);
             }
             else if (pMob->type == shadow) {
-                rv = gfm_playAudio(0, pGame->pCtx, pGame->slime_hit, 0.6);
+                rv = sfx_play(pGame->pSfx, SFX_SLIME_HIT, 0.6);
                 ASSERT(rv == GFMRV_OK, rv);
             }
             else if (pMob->type == player) {
-                rv = gfm_playAudio(0, pGame->pCtx, pGame->pl_hit, 0.6);
+                rv = sfx_play(pGame->pSfx, SFX_PL_HIT, 0.6);
                 ASSERT(rv == GFMRV_OK, rv);
             }
         }
@@ -831,16 +1587,25 @@ gfmRV mob_attack(mob *pSelf, mob *pMob, gameCtx *pGame) {
             rv = gfmSprite_playAnimation(pMob->pSelf, ANIM_DEATH);
             ASSERT(rv == GFMRV_OK, rv);
             
+            rv = gfmSprite_getPosition(&x, &y, pMob->pSelf);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = gfmSprite_getDimensions(&width, &height, pMob->pSelf);
+            ASSERT(rv == GFMRV_OK, rv);
+            
             if (pMob->type == wall) {
-                rv = gfm_playAudio(0, pGame->pCtx, pGame->expl, 0.6);
+                rv = sfx_play(pGame->pSfx, SFX_EXPL, 0.6);
+                ASSERT(rv == GFMRV_OK, rv);
+                rv = playstate_burst(pGame, x, y, width, height, EXPL_PARTS);
                 ASSERT(rv == GFMRV_OK, rv);
             }
             else if (pMob->type == shadow) {
-                rv = gfm_playAudio(0, pGame->pCtx, pGame->slime_death, 0.6);
+                rv = sfx_play(pGame->pSfx, SFX_SLIME_DEATH, 0.6);
+                ASSERT(rv == GFMRV_OK, rv);
+                rv = playstate_burst(pGame, x, y, width, height, SLIME_PARTS);
                 ASSERT(rv == GFMRV_OK, rv);
             }
             else if (pMob->type == player) {
-                rv = gfm_playAudio(0, pGame->pCtx, pGame->pl_death, 0.6);
+                rv = sfx_play(pGame->pSfx, SFX_PL_DEATH, 0.6);
                 ASSERT(rv == GFMRV_OK, rv);
             }
         }
@@ -852,7 +1617,7 @@ __ret:
 }
 
 gfmRV mob_isAlive(mob *pMob) {
-    if (pMob->isAlive) {
+    if (MOB_HOT(pMob, pIsAlive)) {
         return GFMRV_TRUE;
     }
     return GFMRV_FALSE;
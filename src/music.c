@@ -0,0 +1,228 @@
+/**
+ * @file src/music.c
+ *
+ * Background music; The song is played on its own SDL audio device, whose
+ * callback renders blocks of the song into a ring buffer whenever it runs dry
+ */
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmFile.h>
+
+#include <ld33/music.h>
+#include <ld33/synth.h>
+
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** How many samples are rendered at once */
+#define MUSIC_BLOCK 512
+/** Size of the ring buffer, in samples (must be a multiple of the block) */
+#define MUSIC_RING  (MUSIC_BLOCK * 4)
+/** Samples requested by the device on each callback */
+#define MUSIC_DEVICE_SAMPLES 1024
+
+struct stMusic {
+    /** The song */
+    synth *pSynth;
+    /** Rendered samples not yet sent to the device */
+    short pRing[MUSIC_RING];
+    /** How many samples were ever consumed and rendered (the positions on the
+     * ring are these modulo its size) */
+    unsigned int readPos;
+    unsigned int writePos;
+    /** Song's sample rate */
+    int freq;
+    /** Song's volume (from 0 to 256) */
+    int volume;
+    /** Device playing the song (0, if none) */
+    SDL_AudioDeviceID dev;
+};
+
+/**
+ * Called by SDL (on its audio thread) whenever the device needs more samples
+ */
+static void music_callback(void *pArg, Uint8 *pStream, int len) {
+    music *pMusic;
+    short *pOut;
+    int num;
+    
+    pMusic = (music*)pArg;
+    pOut = (short*)pStream;
+    num = len / sizeof(short);
+    
+    while (num > 0) {
+        int avail, i, pos;
+        
+        // Render a block of the song only when the previous one was consumed
+        if (pMusic->writePos == pMusic->readPos) {
+            pos = pMusic->writePos % MUSIC_RING;
+            if (synth_render(pMusic->pSynth, pMusic->pRing + pos, MUSIC_BLOCK)
+                    != GFMRV_OK) {
+                memset(pOut, 0x0, sizeof(short) * num);
+                return;
+            }
+            pMusic->writePos += MUSIC_BLOCK;
+        }
+        
+        pos = pMusic->readPos % MUSIC_RING;
+        avail = (int)(pMusic->writePos - pMusic->readPos);
+        if (avail > MUSIC_RING - pos) {
+            avail = MUSIC_RING - pos;
+        }
+        if (avail > num) {
+            avail = num;
+        }
+        
+        i = 0;
+        while (i < avail) {
+            pOut[i] = (short)(pMusic->pRing[pos + i] * pMusic->volume / 256);
+            i++;
+        }
+        
+        pOut += avail;
+        num -= avail;
+        pMusic->readPos += avail;
+    }
+}
+
+/**
+ * Alloc a new music player
+ */
+gfmRV music_getNew(music **ppMusic) {
+    gfmRV rv;
+    
+    ASSERT(ppMusic, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppMusic), GFMRV_ARGUMENTS_BAD);
+    
+    *ppMusic = (music*)malloc(sizeof(music));
+    ASSERT(*ppMusic, GFMRV_ALLOC_FAILED);
+    
+    memset(*ppMusic, 0x0, sizeof(music));
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Stop the music (if playing) and free its memory
+ */
+gfmRV music_free(music **ppMusic) {
+    gfmRV rv;
+    
+    ASSERT(ppMusic, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppMusic, GFMRV_ARGUMENTS_BAD);
+    
+    // Closing the device waits for the callback to return
+    if ((*ppMusic)->dev) {
+        SDL_CloseAudioDevice((*ppMusic)->dev);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+    if ((*ppMusic)->pSynth) {
+        synth_free(&((*ppMusic)->pSynth));
+    }
+    free(*ppMusic);
+    *ppMusic = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Load and compile a song
+ */
+gfmRV music_load(music *pMusic, gfmCtx *pCtx, char *pFilename, int freq) {
+    gfmFile *pFile;
+    gfmRV rv;
+    int count, size;
+    char *pText;
+    
+    pFile = 0;
+    pText = 0;
+    
+    ASSERT(pMusic, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pCtx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pFilename, GFMRV_ARGUMENTS_BAD);
+    ASSERT(freq > 0, GFMRV_ARGUMENTS_BAD);
+    // The song can't be replaced while it's playing
+    ASSERT(!pMusic->dev, GFMRV_ARGUMENTS_BAD);
+    
+    if (pMusic->pSynth) {
+        synth_free(&(pMusic->pSynth));
+    }
+    rv = synth_getNew(&(pMusic->pSynth), freq);
+    ASSERT(rv == GFMRV_OK, rv);
+    pMusic->freq = freq;
+    
+    // The source is tiny, so simply read it whole
+    rv = gfmFile_getNew(&pFile);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmFile_openAsset(pFile, pCtx, pFilename, strlen(pFilename),
+            0/*isText*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfmFile_getSize(&size, pFile);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    pText = (char*)malloc(size);
+    ASSERT(pText, GFMRV_ALLOC_FAILED);
+    rv = gfmFile_readBytes(pText, &count, pFile, size);
+    ASSERT(rv == GFMRV_OK, rv);
+    ASSERT(count == size, GFMRV_READ_ERROR);
+    
+    rv = synth_compile(pMusic->pSynth, pText, size);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = GFMRV_OK;
+__ret:
+    if (pFile) {
+        gfmFile_free(&pFile);
+    }
+    free(pText);
+    
+    return rv;
+}
+
+/**
+ * Open an audio device and start playing the song
+ */
+gfmRV music_play(music *pMusic, double volume) {
+    SDL_AudioSpec spec;
+    gfmRV rv;
+    
+    ASSERT(pMusic, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pMusic->pSynth, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!pMusic->dev, GFMRV_ARGUMENTS_BAD);
+    
+    pMusic->volume = (int)(volume * 256);
+    pMusic->readPos = 0;
+    pMusic->writePos = 0;
+    
+    ASSERT(SDL_InitSubSystem(SDL_INIT_AUDIO) == 0, GFMRV_INTERNAL_ERROR);
+    
+    memset(&spec, 0x0, sizeof(SDL_AudioSpec));
+    spec.freq = pMusic->freq;
+    spec.format = AUDIO_S16SYS;
+    spec.channels = 1;
+    spec.samples = MUSIC_DEVICE_SAMPLES;
+    spec.callback = music_callback;
+    spec.userdata = pMusic;
+    
+    // SDL converts the samples, if the device can't play them as they are
+    pMusic->dev = SDL_OpenAudioDevice(0, 0/*isCapture*/, &spec, 0,
+            0/*allowedChanges*/);
+    if (!pMusic->dev) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+    ASSERT(pMusic->dev, GFMRV_INTERNAL_ERROR);
+    
+    SDL_PauseAudioDevice(pMusic->dev, 0/*unpause*/);
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
@@ -0,0 +1,340 @@
+/**
+ * @file src/particles.c
+ *
+ * Lightweight particles; Living particles are always packed at the start of
+ * the arrays (dead ones are swapped with the last one), so every loop runs
+ * over contiguous memory without checking whether a particle is alive
+ */
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmSpriteset.h>
+
+#include <ld33/particles.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+struct stParticles {
+    /** Every particle's position */
+    float *pX;
+    float *pY;
+    /** Every particle's velocity */
+    float *pVx;
+    float *pVy;
+    /** How long (in milliseconds) each particle still lives */
+    int *pTtl;
+    /** Every particle's tile */
+    int *pFrame;
+    /** How many particles may be alive */
+    int maxParts;
+    /** How many particles are alive */
+    int numParts;
+    /** Spriteset used to draw every particle */
+    gfmSpriteset *pSset;
+    /** Particles' dimensions */
+    int width;
+    int height;
+    /** Acceleration applied to every particle */
+    float ax;
+    float ay;
+    /** How far outside the camera particles are retired (-1, if never) */
+    int leaveMargin;
+    /** Default time to live of new particles */
+    int ttl;
+    /** State of the generator used on batches */
+    unsigned int seed;
+};
+
+/**
+ * Get a random number within a range (with both limits included)
+ */
+static int particles_random(particles *pParts, int min, int max) {
+    pParts->seed = pParts->seed * 1664525 + 1013904223;
+    // The lower bits repeat too often, so only the upper ones are used
+    return min + (int)((pParts->seed >> 8) % (unsigned int)(max - min + 1));
+}
+
+/**
+ * Alloc a new particle system
+ */
+gfmRV particles_getNew(particles **ppParts, int maxParts) {
+    gfmRV rv;
+    particles *pParts;
+    
+    ASSERT(ppParts, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppParts), GFMRV_ARGUMENTS_BAD);
+    ASSERT(maxParts > 0, GFMRV_ARGUMENTS_BAD);
+    
+    pParts = (particles*)malloc(sizeof(particles));
+    ASSERT(pParts, GFMRV_ALLOC_FAILED);
+    memset(pParts, 0x0, sizeof(particles));
+    *ppParts = pParts;
+    
+    pParts->pX = (float*)malloc(sizeof(float) * maxParts);
+    pParts->pY = (float*)malloc(sizeof(float) * maxParts);
+    pParts->pVx = (float*)malloc(sizeof(float) * maxParts);
+    pParts->pVy = (float*)malloc(sizeof(float) * maxParts);
+    pParts->pTtl = (int*)malloc(sizeof(int) * maxParts);
+    pParts->pFrame = (int*)malloc(sizeof(int) * maxParts);
+    if (!pParts->pX || !pParts->pY || !pParts->pVx || !pParts->pVy ||
+            !pParts->pTtl || !pParts->pFrame) {
+        particles_free(ppParts);
+    }
+    ASSERT(*ppParts, GFMRV_ALLOC_FAILED);
+    pParts->maxParts = maxParts;
+    pParts->leaveMargin = -1;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Free the particle system's memory
+ */
+gfmRV particles_free(particles **ppParts) {
+    gfmRV rv;
+    
+    ASSERT(ppParts, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppParts, GFMRV_ARGUMENTS_BAD);
+    
+    free((*ppParts)->pX);
+    free((*ppParts)->pY);
+    free((*ppParts)->pVx);
+    free((*ppParts)->pVy);
+    free((*ppParts)->pTtl);
+    free((*ppParts)->pFrame);
+    free(*ppParts);
+    *ppParts = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Set how every particle looks and moves
+ */
+gfmRV particles_init(particles *pParts, gfmSpriteset *pSset, int width,
+        int height, int ax, int ay, int ttl, unsigned int seed) {
+    gfmRV rv;
+    
+    ASSERT(pParts, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pSset, GFMRV_ARGUMENTS_BAD);
+    ASSERT(width > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(height > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(ttl > 0, GFMRV_ARGUMENTS_BAD);
+    
+    pParts->pSset = pSset;
+    pParts->width = width;
+    pParts->height = height;
+    pParts->ax = (float)ax;
+    pParts->ay = (float)ay;
+    pParts->ttl = ttl;
+    pParts->seed = seed;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Set whether particles are retired as soon as they leave the camera
+ */
+gfmRV particles_setDeathOnLeave(particles *pParts, int margin) {
+    gfmRV rv;
+    
+    ASSERT(pParts, GFMRV_ARGUMENTS_BAD);
+    
+    pParts->leaveMargin = (margin < 0) ? -1 : margin;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Add a batch of particles at once
+ */
+gfmRV particles_emitBatch(particles *pParts, gfmCtx *pCtx,
+        const particleEmitter *pEmitter, int num) {
+    gfmRV rv;
+    int i, last, minTtl, maxTtl, x, y;
+    
+    ASSERT(pParts, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pCtx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pEmitter, GFMRV_ARGUMENTS_BAD);
+    ASSERT(num >= 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pEmitter->width > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pEmitter->height > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pEmitter->minVx <= pEmitter->maxVx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pEmitter->minVy <= pEmitter->maxVy, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pEmitter->firstTile <= pEmitter->lastTile, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pEmitter->minTtl <= pEmitter->maxTtl, GFMRV_ARGUMENTS_BAD);
+    
+    // Everything that is shared by the batch is only retrieved once
+    x = pEmitter->x;
+    y = pEmitter->y;
+    if (pEmitter->isCameraRelative) {
+        int camX, camY;
+        
+        rv = gfm_getCameraPosition(&camX, &camY, pCtx);
+        ASSERT(rv == GFMRV_OK, rv);
+        x += camX;
+        y += camY;
+    }
+    minTtl = pEmitter->minTtl;
+    maxTtl = pEmitter->maxTtl;
+    if (maxTtl <= 0) {
+        minTtl = pParts->ttl;
+        maxTtl = pParts->ttl;
+    }
+    
+    i = pParts->numParts;
+    last = i + num;
+    if (last > pParts->maxParts) {
+        last = pParts->maxParts;
+    }
+    while (i < last) {
+        pParts->pX[i] = (float)particles_random(pParts, x,
+                x + pEmitter->width - 1);
+        pParts->pY[i] = (float)particles_random(pParts, y,
+                y + pEmitter->height - 1);
+        pParts->pVx[i] = (float)particles_random(pParts, pEmitter->minVx,
+                pEmitter->maxVx);
+        pParts->pVy[i] = (float)particles_random(pParts, pEmitter->minVy,
+                pEmitter->maxVy);
+        pParts->pTtl[i] = particles_random(pParts, minTtl, maxTtl);
+        pParts->pFrame[i] = particles_random(pParts, pEmitter->firstTile,
+                pEmitter->lastTile);
+        i++;
+    }
+    pParts->numParts = last;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Move every particle and remove the ones whose time is up (or that left the
+ * camera)
+ */
+gfmRV particles_update(particles *pParts, gfmCtx *pCtx) {
+    float *pX, *pY, *pVx, *pVy;
+    float bottom, dt, dvx, dvy, left, right, top;
+    gfmRV rv;
+    int *pTtl;
+    int elapsed, i, num;
+    
+    ASSERT(pParts, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pCtx, GFMRV_ARGUMENTS_BAD);
+    
+    rv = gfm_getElapsedTime(&elapsed, pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    dt = elapsed / 1000.0f;
+    dvx = pParts->ax * dt;
+    dvy = pParts->ay * dt;
+    
+    // Local copies, so the compiler knows the arrays don't change within the
+    // loops (and may vectorize them)
+    pX = pParts->pX;
+    pY = pParts->pY;
+    pVx = pParts->pVx;
+    pVy = pParts->pVy;
+    pTtl = pParts->pTtl;
+    num = pParts->numParts;
+    
+    // Integrate every particle, without any branch
+    i = 0;
+    while (i < num) {
+        pVx[i] += dvx;
+        pVy[i] += dvy;
+        pX[i] += pVx[i] * dt;
+        pY[i] += pVy[i] * dt;
+        pTtl[i] -= elapsed;
+        i++;
+    }
+    
+    // Find the area particles may be in (which is infinite if they are never
+    // retired by leaving it)
+    left = -1e30f;
+    top = -1e30f;
+    right = 1e30f;
+    bottom = 1e30f;
+    if (pParts->leaveMargin >= 0) {
+        int camX, camY, height, width;
+        
+        rv = gfm_getCameraPosition(&camX, &camY, pCtx);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = gfm_getBackbufferDimensions(&width, &height, pCtx);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        left = (float)(camX - pParts->leaveMargin - pParts->width);
+        top = (float)(camY - pParts->leaveMargin - pParts->height);
+        right = (float)(camX + width + pParts->leaveMargin);
+        bottom = (float)(camY + height + pParts->leaveMargin);
+    }
+    
+    // Remove expired particles by moving the last one into their place
+    i = 0;
+    while (i < num) {
+        if (pTtl[i] <= 0 || pX[i] < left || pY[i] < top || pX[i] >= right ||
+                pY[i] >= bottom) {
+            num--;
+            pX[i] = pX[num];
+            pY[i] = pY[num];
+            pVx[i] = pVx[num];
+            pVy[i] = pVy[num];
+            pTtl[i] = pTtl[num];
+            pParts->pFrame[i] = pParts->pFrame[num];
+            continue;
+        }
+        i++;
+    }
+    pParts->numParts = num;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Draw every particle within the camera
+ */
+gfmRV particles_draw(particles *pParts, gfmCtx *pCtx) {
+    gfmRV rv;
+    int camX, camY, height, i, width;
+    
+    ASSERT(pParts, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pCtx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pParts->pSset, GFMRV_ARGUMENTS_BAD);
+    
+    rv = gfm_getCameraPosition(&camX, &camY, pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = gfm_getBackbufferDimensions(&width, &height, pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    i = 0;
+    while (i < pParts->numParts) {
+        int x, y;
+        
+        x = (int)pParts->pX[i] - camX;
+        y = (int)pParts->pY[i] - camY;
+        if (x > -pParts->width && y > -pParts->height && x < width &&
+                y < height) {
+            rv = gfm_drawTile(pCtx, pParts->pSset, x, y, pParts->pFrame[i],
+                    0/*isFlipped*/);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        
+        i++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
@@ -4,24 +4,86 @@
  * Game's main state, where all the fun should happen
  */
 #include <GFraMe/gfmGenericArray.h>
-#include <GFraMe/gfmGroup.h>
-#include <GFraMe/gfmParser.h>
 
+#include <ld33/collision.h>
+#include <ld33/flowfield.h>
+#include <ld33/level.h>
 #include <ld33/playstate.h>
 #include <ld33/main.h>
 #include <ld33/mob.h>
+#include <ld33/particles.h>
+#include <ld33/sfx.h>
 
+#include <stdlib.h>
 #include <string.h>
 
-gfmGenArr_define(mob);
+/** Width of each of the level's chunks (i.e., a screen) */
+#define CHUNK_WIDTH   160
+/** How many chunks are kept loaded behind the camera */
+#define CHUNKS_BEHIND 1
+/** How many chunks are kept loaded ahead of the camera */
+#define CHUNKS_AHEAD  2
+/** Dimensions of each of the flowfield's cells */
+#define FLOW_CELL     8
+/** Dimensions of the camera */
+#define VIEW_WIDTH    160
+#define VIEW_HEIGHT   120
+
+/** Leaves falling from the top of the camera (and a screen to each side) */
+static const particleEmitter leafEmitter = {
+    -VIEW_WIDTH/*x*/, 8/*y*/, VIEW_WIDTH * 3/*width*/, 1/*height*/,
+    1/*isCameraRelative*/,
+    -4/*minVx*/, 3/*maxVx*/, 14/*minVy*/, 21/*maxVy*/,
+    256/*firstTile*/, 259/*lastTile*/,
+    0/*minTtl*/, 0/*maxTtl*/
+};
+
+/** A mob on the camera, and the depth it's drawn at */
+struct stPsDrawable {
+    mob *pMob;
+    /** Mob's vertical position (mobs closer to the top are drawn first) */
+    int y;
+    /** Mob's index on the pool, so ties are always drawn in the same order */
+    int index;
+};
+typedef struct stPsDrawable psDrawable;
 
 struct stPlaystate {
-    /** Array of objects */
-    gfmGenArr_var(mob, pMobs);
+    /** Every mob on the level */
+    mobPool *pMobs;
     /** Leaf particles */
-    gfmGroup *pGrp;
+    particles *pParts;
+    /** Level's template, from which every run is spawned */
+    level *pLevel;
     /** world bounds */
-    gfmObject *pWorld[5];
+    gfmObject **ppWorld;
+    /** How many world bounds there are */
+    int numWorld;
+    /** Mob created by each of the level's spawns (if it's currently loaded) */
+    mob **ppSpawned;
+    /** Whether each of the level's spawns was killed on the current run */
+    char *pKilled;
+    /** Index of the player's spawn */
+    int playerSpawn;
+    /** First chunk currently loaded */
+    int firstChunk;
+    /** Last chunk currently loaded */
+    int lastChunk;
+    /** Mobs close enough to the camera to be simulated on this frame */
+    mob **ppAwake;
+    /** How many mobs fit on the awake list */
+    int awakeLen;
+    /** How many mobs are awake */
+    int numAwake;
+    /** Mobs on the camera, sorted by depth every frame */
+    psDrawable *pVisible;
+    /** How many mobs fit on the visible list */
+    int visibleLen;
+    /** Whether the flowfield's obstacles changed (i.e., chunks were loaded or
+     * a wall was destroyed) */
+    int isFlowDirty;
+    /** Whether the level was already loaded (and kept between runs) */
+    int isLoaded;
     /** World's height */
     int height;
     /** State to be set when exiting */
@@ -33,249 +95,503 @@ struct stPlaystate {
 };
 typedef struct stPlaystate playstate;
 
-#ifdef EMSCRIPT
+/** Kept between runs, so restarting doesn't reload the level */
 static playstate psCtx;
-#endif
 
 /**
- * Initialize everything
+ * Create everything that is kept between runs (i.e., the parsed level, the
+ * world bounds and the particles); Only done the first time the playstate is
+ * entered
  */
-static gfmRV playstate_init(gameCtx *pGame) {
-    gfmCamera *pCam;
-    gfmParser *pParser;
+static gfmRV playstate_load(gameCtx *pGame) {
     gfmRV rv;
-    int curWorld;
+    int i, num;
+    levelArea *pAreas;
+    levelSpawn *pSpawns;
     playstate *pState;
     
     pState = (playstate*)pGame->pState;
-    pParser = 0;
-    
-    pGame->didWin = 0;
-    pGame->didLose = 0;
     
     // Initialize the rendering group
     rv = main_cleanRenderGroup(pGame);
     ASSERT(rv == GFMRV_OK, rv);
     
-    // Parse all objects
-    rv = gfmParser_getNew(&pParser);
+    rv = mobPool_getNew(&(pState->pMobs));
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmParser_initStatic(pParser, pGame->pCtx, "map.gfm");
+    
+    // Load all objects; The text map is only parsed if the compiled one is
+    // missing (or outdated)
+    rv = level_getNew(&(pState->pLevel));
     ASSERT(rv == GFMRV_OK, rv);
+    if (pGame->pLevelPath) {
+        rv = level_loadMapped(pState->pLevel, pGame->pLevelPath);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    else {
+        rv = level_loadBinary(pState->pLevel, pGame->pCtx, "map.bin");
+    }
+    if (rv != GFMRV_OK) {
+        rv = level_loadStatic(pState->pLevel, pGame->pCtx, "map.gfm");
+        ASSERT(rv == GFMRV_OK, rv);
+    }
     
-    pState->width = 0;
-    pState->height = 120;
-    curWorld = 0;
-    while (rv != GFMRV_PARSER_FINISHED) {
-        char *pType;
-        gfmParserType type;
-        int x, y;
+    rv = level_getDimensions(&(pState->width), &(pState->height),
+            pState->pLevel);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = level_indexChunks(pState->pLevel, CHUNK_WIDTH);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Create the world bounds
+    rv = level_getAreas(&pAreas, &num, pState->pLevel);
+    ASSERT(rv == GFMRV_OK, rv);
+    if (num > 0) {
+        pState->ppWorld = (gfmObject**)malloc(sizeof(gfmObject*) * num);
+        ASSERT(pState->ppWorld, GFMRV_ALLOC_FAILED);
+    }
+    i = 0;
+    while (i < num) {
+        gfmGenArr_getNextRef(gfmObject, pGame->pObjs, 1, pState->ppWorld[i],
+                gfmObject_getNew);
+        gfmGenArr_push(pGame->pObjs);
         
-        rv = gfmParser_parseNext(pParser);
-        ASSERT(rv == GFMRV_OK || rv == GFMRV_PARSER_FINISHED, rv);
-        if (rv == GFMRV_PARSER_FINISHED) {
-            break;
-        }
+        rv = gfmObject_init(pState->ppWorld[i], pAreas[i].x, pAreas[i].y,
+                pAreas[i].width, pAreas[i].height, 0/*child*/,
+                pAreas[i].type);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = gfmObject_setFixed(pState->ppWorld[i]);
+        ASSERT(rv == GFMRV_OK, rv);
         
-        rv = gfmParser_getType(&type, pParser);
+        i++;
+    }
+    pState->numWorld = num;
+    
+    // Alloc whatever is used to keep track of the spawns on each run
+    rv = level_getSpawns(&pSpawns, &num, pState->pLevel);
+    ASSERT(rv == GFMRV_OK, rv);
+    if (num > 0) {
+        pState->ppSpawned = (mob**)malloc(sizeof(mob*) * num);
+        ASSERT(pState->ppSpawned, GFMRV_ALLOC_FAILED);
+        pState->pKilled = (char*)malloc(sizeof(char) * num);
+        ASSERT(pState->pKilled, GFMRV_ALLOC_FAILED);
+    }
+    pState->playerSpawn = -1;
+    i = 0;
+    while (i < num) {
+        if (pSpawns[i].type == player) {
+            pState->playerSpawn = i;
+        }
+        i++;
+    }
+    ASSERT(pState->playerSpawn >= 0, GFMRV_INTERNAL_ERROR);
+    
+    rv = particles_getNew(&(pState->pParts), pGame->maxParts);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = particles_init(pState->pParts, pGame->pSset4x4, 4/*width*/,
+            4/*height*/, 0/*ax*/, 2/*ay*/, 4000/*ttl*/,
+            (unsigned int)main_getPRNG(pGame));
+    ASSERT(rv == GFMRV_OK, rv);
+    // Leaves fall within the emitter's area, so they are only retired once
+    // the camera leaves them more than a screen behind
+    rv = particles_setDeathOnLeave(pState->pParts, VIEW_WIDTH/*margin*/);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    pState->isLoaded = 1;
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Spawn a mob from the level's template
+ * 
+ * @param  pGame   The game's context
+ * @param  spawnId Index of the spawn within the level
+ */
+static gfmRV playstate_spawn(gameCtx *pGame, int spawnId) {
+    gfmRV rv;
+    int num;
+    levelSpawn *pSpawn;
+    mob *pMob;
+    playstate *pState;
+    
+    pState = (playstate*)pGame->pState;
+    
+    rv = level_getSpawns(&pSpawn, &num, pState->pLevel);
+    ASSERT(rv == GFMRV_OK, rv);
+    ASSERT(spawnId >= 0 && spawnId < num, GFMRV_ARGUMENTS_BAD);
+    pSpawn += spawnId;
+    
+    // Initialize the mob
+    rv = mobPool_getNext(&pMob, pState->pMobs);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = mob_init(pMob, pGame, pSpawn->type, pSpawn->level);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mob_setPosition(pMob, pSpawn->x, pSpawn->y);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    if (pSpawn->type == shadow) {
+        rv = mob_setTraits(pMob, pSpawn->traits);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = mob_setAnimations(pMob, pSpawn->subtype);
         ASSERT(rv == GFMRV_OK, rv);
-        rv = gfmParser_getPos(&x, &y, pParser);
+        rv = mob_setDist(pMob, pSpawn->dist);
         ASSERT(rv == GFMRV_OK, rv);
-        rv = gfmParser_getIngameType(&pType, pParser);
+    }
+    else {
+        rv = mob_setAnimations(pMob, 0/*unused*/);
         ASSERT(rv == GFMRV_OK, rv);
+    }
+    
+    if (pSpawn->type == player) {
+        pState->pPlayer = pMob;
+    }
+    else {
+        // Only mobs that can be streamed in and out keep track of their spawn
+        rv = mob_setSpawnId(pMob, spawnId);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    pState->ppSpawned[spawnId] = pMob;
+    
+    rv = mob_populateStatic(pMob, pGame);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Unload every mob too far from the camera and, if the camera got into other
+ * chunks, load the ones around it; Killed mobs aren't respawned until the next
+ * run
+ */
+static gfmRV playstate_stream(gameCtx *pGame) {
+    gfmRV rv;
+    int camX, camY, chunk, first, i, last, numChunks, winEnd, winX;
+    levelSpawn *pSpawns;
+    playstate *pState;
+    
+    pState = (playstate*)pGame->pState;
+    
+    rv = gfm_getCameraPosition(&camX, &camY, pGame->pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    numChunks = level_getChunkCount(pState->pLevel);
+    first = camX / CHUNK_WIDTH - CHUNKS_BEHIND;
+    last = (camX + CHUNK_WIDTH - 1) / CHUNK_WIDTH + CHUNKS_AHEAD;
+    if (first < 0) {
+        first = 0;
+    }
+    if (last >= numChunks) {
+        last = numChunks - 1;
+    }
+    
+    // Mobs beyond the level's edges belong to its first/last chunk
+    winX = first * CHUNK_WIDTH;
+    winEnd = (last + 1) * CHUNK_WIDTH;
+    if (first == 0) {
+        winX = -pState->width;
+    }
+    if (last == numChunks - 1) {
+        winEnd = pState->width * 2;
+    }
+    
+    // Unload every mob that left the loaded chunks; Done every frame, since
+    // mobs may chase/flee out of them even if the camera didn't move
+    i = 0;
+    while (i < mobPool_getActiveCount(pState->pMobs)) {
+        mob *pMob;
+        int id, x, y;
         
-#define CHECK_TYPE(str) strcmp(pType, str) == 0
-        if (type == gfmParserType_area) {
-            int height, width;
+        pMob = mobPool_getActive(pState->pMobs, i);
+        id = mob_getSpawnId(pMob);
+        
+        if (id >= 0 && mob_isAlive(pMob) == GFMRV_TRUE) {
+            rv = mob_getPosition(&x, &y, pMob);
+            ASSERT(rv == GFMRV_OK, rv);
             
-            if (CHECK_TYPE("win")) {
-                gfmGenArr_getNextRef(gfmObject, pGame->pObjs, 1,
-                        pState->pWorld[curWorld], gfmObject_getNew);
-                gfmGenArr_push(pGame->pObjs);
-
-                rv = gfmParser_getDimensions(&width, &height, pParser);
+            if (x < winX || x >= winEnd) {
+                rv = mob_despawn(pMob, pGame);
                 ASSERT(rv == GFMRV_OK, rv);
+                pState->ppSpawned[id] = 0;
+            }
+        }
+        
+        i++;
+    }
+    
+    // Only the spawns depend on which chunks are loaded
+    if (first == pState->firstChunk && last == pState->lastChunk) {
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    // Load every chunk that just got into range
+    rv = level_getSpawns(&pSpawns, &i, pState->pLevel);
+    ASSERT(rv == GFMRV_OK, rv);
+    chunk = first;
+    while (chunk <= last) {
+        if (chunk < pState->firstChunk || chunk > pState->lastChunk) {
+            int *pIndices, j, num;
+            
+            rv = level_getChunkSpawns(&pIndices, &num, pState->pLevel, chunk);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            j = 0;
+            while (j < num) {
+                int id;
                 
-                rv = gfmObject_init(pState->pWorld[curWorld], x, y, width,
-                        height, 0/*child*/, win/*type*/);
-                ASSERT(rv == GFMRV_OK, rv);
-                rv = gfmObject_setFixed(pState->pWorld[curWorld]);
-                ASSERT(rv == GFMRV_OK, rv);
+                id = pIndices[j];
+                if (!pState->pKilled[id] && !pState->ppSpawned[id] &&
+                        pSpawns[id].type != player) {
+                    rv = playstate_spawn(pGame, id);
+                    ASSERT(rv == GFMRV_OK, rv);
+                }
                 
-                curWorld++;
+                j++;
             }
-            else if (CHECK_TYPE("collideable")) {
-                gfmGenArr_getNextRef(gfmObject, pGame->pObjs, 1,
-                        pState->pWorld[curWorld], gfmObject_getNew);
-                gfmGenArr_push(pGame->pObjs);
+        }
+        
+        chunk++;
+    }
+    
+    pState->firstChunk = first;
+    pState->lastChunk = last;
+    pState->isFlowDirty = 1;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
 
-                rv = gfmParser_getDimensions(&width, &height, pParser);
-                ASSERT(rv == GFMRV_OK, rv);
-                
-                rv = gfmObject_init(pState->pWorld[curWorld], x, y, width,
-                        height, 0/*child*/, collideable/*type*/);
-                ASSERT(rv == GFMRV_OK, rv);
-                rv = gfmObject_setFixed(pState->pWorld[curWorld]);
+/**
+ * List every mob within the margin around the camera; Every other mob is asleep
+ * (i.e., it isn't seen by others, doesn't think, move, animate nor collide)
+ * until it gets into the margin again
+ */
+static gfmRV playstate_wake(gameCtx *pGame) {
+    gfmRV rv;
+    int bottom, camX, camY, i, left, num, right, top;
+    playstate *pState;
+    
+    pState = (playstate*)pGame->pState;
+    
+    num = mobPool_getActiveCount(pState->pMobs);
+    if (num > pState->awakeLen) {
+        mob **ppTmp;
+        
+        ppTmp = (mob**)realloc(pState->ppAwake, sizeof(mob*) * num);
+        ASSERT(ppTmp, GFMRV_ALLOC_FAILED);
+        pState->ppAwake = ppTmp;
+        pState->awakeLen = num;
+    }
+    
+    rv = gfm_getCameraPosition(&camX, &camY, pGame->pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    left = camX - pGame->sleepMargin;
+    top = camY - pGame->sleepMargin;
+    right = camX + VIEW_WIDTH + pGame->sleepMargin;
+    bottom = camY + VIEW_HEIGHT + pGame->sleepMargin;
+    
+    pState->numAwake = 0;
+    i = 0;
+    while (i < num) {
+        mob *pMob;
+        int x, y;
+        
+        pMob = mobPool_getActive(pState->pMobs, i);
+        rv = mob_getPosition(&x, &y, pMob);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        // The player is always awake, since the camera follows it
+        if (pMob == pState->pPlayer ||
+                (x >= left && x < right && y >= top && y < bottom)) {
+            pState->ppAwake[pState->numAwake] = pMob;
+            pState->numAwake++;
+        }
+        
+        i++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Point the flowfield at the player; Its obstacles (the world's bounds and
+ * every wall) are only rebuilt, over the loaded chunks, if they changed
+ */
+static gfmRV playstate_updateFlow(gameCtx *pGame, int winX, int winWidth) {
+    gfmRV rv;
+    int h, i, w, x, y;
+    playstate *pState;
+    
+    pState = (playstate*)pGame->pState;
+    
+    if (pState->isFlowDirty) {
+        levelArea *pAreas;
+        int num;
+        
+        rv = flowfield_init(pGame->pFlow, winX, 0/*y*/, winWidth,
+                pState->height, FLOW_CELL);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        rv = level_getAreas(&pAreas, &num, pState->pLevel);
+        ASSERT(rv == GFMRV_OK, rv);
+        i = 0;
+        while (i < num) {
+            if (pAreas[i].type == collideable) {
+                rv = flowfield_block(pGame->pFlow, pAreas[i].x, pAreas[i].y,
+                        pAreas[i].width, pAreas[i].height);
                 ASSERT(rv == GFMRV_OK, rv);
-                
-                // Get the world's dimensions
-                if (width > pState->width) {
-                    pState->width = width;
-                }
-                
-                curWorld++;
-            } // if type == collideable
-            else {
-                ASSERT(0, GFMRV_INTERNAL_ERROR);
             }
-        } // if type == area
-        else if (type == gfmParserType_object) {
+            
+            i++;
+        }
+        
+        i = 0;
+        while (i < mobPool_getActiveCount(pState->pMobs)) {
             mob *pMob;
+            int type;
             
-            // Initialize the mob
-            gfmGenArr_getNextRef(mob, pState->pMobs, 1, pMob, mob_getNew);
-            gfmGenArr_push(pState->pMobs);
+            pMob = mobPool_getActive(pState->pMobs, i);
+            rv = mob_getType(&type, pMob);
+            ASSERT(rv == GFMRV_OK, rv);
             
-            if (CHECK_TYPE("player")) {
-                rv = mob_init(pMob, pGame, player, 1/*level*/);
-                ASSERT(rv == GFMRV_OK, rv);
-                
-                rv = mob_setAnimations(pMob, 0/*unused*/);
+            if (type == wall && mob_isAlive(pMob) == GFMRV_TRUE) {
+                rv = mob_getPosition(&x, &y, pMob);
                 ASSERT(rv == GFMRV_OK, rv);
-                
-                rv = mob_setPosition(pMob, x, y);
+                rv = mob_getDimensions(&w, &h, pMob);
                 ASSERT(rv == GFMRV_OK, rv);
                 
-                pState->pPlayer = pMob;
-            } // if type == player
-            else if (CHECK_TYPE("shadow")) {
-                int num, dist, level, subtype, traits;
-                
-                dist = 48;
-                level = 1;
-                subtype = EN_NONE;
-                traits = TR_NONE;
-                
-                rv = gfmParser_getNumProperties(&num, pParser);
-                ASSERT(rv == GFMRV_OK, rv);
-                while (num > 0) {
-                    char *pKey, *pVal;
-                    
-                    rv = gfmParser_getProperty(&pKey, &pVal, pParser, num - 1);
-                    ASSERT(rv == GFMRV_OK, rv);
-                    
-#define CHECK_KEY(str) strcmp(pKey, str) == 0
-#define CHECK_VAL(str) strcmp(pVal, str) == 0
-                    if (CHECK_KEY("level")) {
-                        level = 0;
-                        while (*pVal) {
-                            level = level * 10 + (*pVal) - '0';
-                            pVal++;
-                        }
-                    }
-                    else if (CHECK_KEY("subtype")) {
-                        if (CHECK_VAL("slime")) subtype = EN_SLIME;
-                        else if (CHECK_VAL("angrySlime")) subtype = EN_ANGRYSLIME;
-                        else if (CHECK_VAL("swarmSlime")) subtype = EN_SWARMSLIME;
-                        else ASSERT(0, GFMRV_INTERNAL_ERROR);
-                    }
-                    else if (CHECK_KEY("trait")) {
-                        if (CHECK_VAL("coward")) traits |= TR_COWARD;
-                        else if (CHECK_VAL("neutral")) traits |= TR_NEUTRAL;
-                        else if (CHECK_VAL("angry")) traits |= TR_ANGRY;
-                        else if (CHECK_VAL("swarmer")) traits |= TR_SWARMER;
-                        else ASSERT(0, GFMRV_INTERNAL_ERROR);
-                    }
-                    else if (CHECK_KEY("dist")) {
-                        dist = 0;
-                        while (*pVal) {
-                            dist = dist * 10 + (*pVal) - '0';
-                            pVal++;
-                        }
-                    }
-                    else {
-                        ASSERT(0, GFMRV_INTERNAL_ERROR);
-                    }
-#undef CHECK_VAL
-#undef CHECK_KEY
-                    num--;
-                } // while num < numProps
-                
-                rv = mob_init(pMob, pGame, shadow, level);
-                ASSERT(rv == GFMRV_OK, rv);
-                rv = mob_setPosition(pMob, x, y);
-                ASSERT(rv == GFMRV_OK, rv);
-                rv = mob_setTraits(pMob, traits);
+                rv = flowfield_block(pGame->pFlow, x, y, w, h);
                 ASSERT(rv == GFMRV_OK, rv);
-                rv = mob_setAnimations(pMob, subtype);
-                ASSERT(rv == GFMRV_OK, rv);
-                rv = mob_setDist(pMob, dist);
-                ASSERT(rv == GFMRV_OK, rv);
-            } // if pType == "shadow"
-            else if (CHECK_TYPE("wall")) {
-                rv = mob_init(pMob, pGame, wall, 1);
-                ASSERT(rv == GFMRV_OK, rv);
-                rv = mob_setPosition(pMob, x, y);
-                ASSERT(rv == GFMRV_OK, rv);
-                rv = mob_setAnimations(pMob, 0/*unused*/);
-                ASSERT(rv == GFMRV_OK, rv);
-            }
-            else {
-                ASSERT(0, GFMRV_INTERNAL_ERROR);
             }
+            
+            i++;
         }
-        else {
-            ASSERT(0, GFMRV_INTERNAL_ERROR);
-        }
-#undef CHECK_TYPE
+        
+        pState->isFlowDirty = 0;
     }
     
-    // Set camera's dimensions
-    rv = gfm_getCamera(&pCam, pGame->pCtx);
+    rv = mob_getPosition(&x, &y, pState->pPlayer);
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmCamera_setWorldDimensions(pCam, pState->width, pState->height);
-    ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmCamera_setDeadzone(pCam, 60/*x*/, 0/*y*/, 40/*width*/,
-            120/*height*/);
+    rv = mob_getDimensions(&w, &h, pState->pPlayer);
     ASSERT(rv == GFMRV_OK, rv);
+    rv = flowfield_update(pGame->pFlow, x + w / 2, y + h / 2);
+__ret:
+    return rv;
+}
+
+/**
+ * Initialize everything; After the first run, the level is restored from its
+ * template and every mob is reused in place; Only the player and the chunks
+ * around it are spawned
+ */
+static gfmRV playstate_init(gameCtx *pGame) {
+    gfmCamera *pCam;
+    gfmRV rv;
+    int i, num, x, y;
+    levelSpawn *pSpawns;
+    playstate *pState;
     
-    rv = gfmGroup_getNew(&(pState->pGrp));
-    ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_setDefSpriteset(pState->pGrp, pGame->pSset4x4);
-    ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_setDefDimensions(pState->pGrp, 4 /*width*/, 4 /*height*/,
-        0/*offX*/, 0/*offY*/);
+    pState = (playstate*)pGame->pState;
+    
+    pGame->didWin = 0;
+    pGame->didLose = 0;
+    
+    if (!pState->isLoaded) {
+        rv = playstate_load(pGame);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    else {
+        rv = mobPool_reset(pState->pMobs);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
+    
+    // Nothing was spawned nor killed yet
+    rv = level_getSpawns(&pSpawns, &num, pState->pLevel);
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_setDefVelocity(pState->pGrp, 0/*vx*/, 32/*vy*/);
+    if (num > 0) {
+        memset(pState->ppSpawned, 0x0, sizeof(mob*) * num);
+        memset(pState->pKilled, 0x0, sizeof(char) * num);
+    }
+    pState->firstChunk = -1;
+    pState->lastChunk = -1;
+    
+    // Add everything that never moves to the static collision layer
+    rv = collide_initStatic(pGame, pState->width, pState->height);
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_setDefAcceleration(pState->pGrp, 0/*ax*/, 2/*ay*/);
+    i = 0;
+    while (i < pState->numWorld) {
+        rv = collide_addStaticObj(pState->ppWorld[i], pGame);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        i++;
+    }
+    
+    rv = playstate_spawn(pGame, pState->playerSpawn);
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_setDeathOnTime(pState->pGrp, 4000/*ttl*/);
+    
+    // Set camera's dimensions
+    rv = gfm_getCamera(&pCam, pGame->pCtx);
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_setDeathOnLeave(pState->pGrp, 0/*dontDie*/);
+    rv = gfmCamera_setWorldDimensions(pCam, pState->width, pState->height);
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_setDrawOrder(pState->pGrp, gfmDrawOrder_linear);
+    rv = gfmCamera_setDeadzone(pCam, 60/*x*/, 0/*y*/, 40/*width*/,
+            120/*height*/);
     ASSERT(rv == GFMRV_OK, rv);
-    rv = gfmGroup_preCache(pState->pGrp, pGame->maxParts, pGame->maxParts);
+    
+    // Load everything around the player
+    x = pSpawns[pState->playerSpawn].x;
+    y = pSpawns[pState->playerSpawn].y;
+    rv = gfmCamera_centerAtPoint(pCam, x, y);
+    ASSERT(rv == GFMRV_CAMERA_MOVED || rv == GFMRV_CAMERA_DIDNT_MOVE, rv);
+    rv = playstate_stream(pGame);
     ASSERT(rv == GFMRV_OK, rv);
     
     rv = GFMRV_OK;
 __ret:
-    gfmParser_free(&pParser);
-    
     return rv;
 }
 
 /**
- * Clean everything
+ * Release everything kept between runs
  */
-static void playstate_clean(gameCtx *pGame) {
+gfmRV playstate_free(gameCtx *pGame) {
     playstate *pState;
     
-    pState = (playstate*)pGame->pState;
+    pState = &psCtx;
     
-    gfmGenArr_clean(pState->pMobs, mob_free);
-    gfmGroup_free(&(pState->pGrp));
+    if (pState->pMobs) {
+        mobPool_free(&(pState->pMobs));
+    }
+    if (pState->pLevel) {
+        level_free(&(pState->pLevel));
+    }
+    free(pState->ppWorld);
+    pState->ppWorld = 0;
+    free(pState->ppSpawned);
+    pState->ppSpawned = 0;
+    free(pState->pKilled);
+    pState->pKilled = 0;
+    free(pState->ppAwake);
+    pState->ppAwake = 0;
+    pState->awakeLen = 0;
+    free(pState->pVisible);
+    pState->pVisible = 0;
+    pState->visibleLen = 0;
+    if (pState->pParts) {
+        particles_free(&(pState->pParts));
+    }
+    // Release every hitbox used by this level (they are kept alloc'ed and
+    // reused on the next one)
+    gfmGenArr_reset(pGame->pObjs);
+    pState->isLoaded = 0;
+    
+    return GFMRV_OK;
 }
 
 /**
@@ -283,7 +599,7 @@ static void playstate_clean(gameCtx *pGame) {
  */
 static gfmRV playstate_update(gameCtx *pGame) {
     gfmRV rv;
-    int i, num;
+    int i, num, winWidth, winX;
     playstate *pState;
     
     pState = (playstate*)pGame->pState;
@@ -294,91 +610,129 @@ static gfmRV playstate_update(gameCtx *pGame) {
         pGame->state = state_blastate;
     }
     
-    // Initialize the qt
-    rv = gfmQuadtree_initRoot(pGame->pQt, 0/*x*/, 0/*y*/, pState->width,
-            pState->height, 6/*maxDepth*/, 10/*maxNodes*/);
+    // Switch between the quadtree and the grid, to compare them (on any build,
+    // so they may be timed with optimizations)
+    if ((pGame->state_broadphase & gfmInput_justPressed) ==
+            gfmInput_justPressed) {
+        if (pGame->broadphase == broadphase_quadtree) {
+            pGame->broadphase = broadphase_grid;
+        }
+        else {
+            pGame->broadphase = broadphase_quadtree;
+        }
+    }
+
+    // Load (and unload) the chunks around the camera
+    rv = playstate_stream(pGame);
     ASSERT(rv == GFMRV_OK, rv);
     
-    // Add world to quadtree
+    // Only the loaded chunks are partitioned (the world itself is on the
+    // static layer)
+    winX = pState->firstChunk * CHUNK_WIDTH;
+    winWidth = (pState->lastChunk - pState->firstChunk + 1) * CHUNK_WIDTH;
+    rv = collide_initFrame(pGame, winX, winWidth, pState->height);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Only mobs around the camera are simulated
+    rv = playstate_wake(pGame);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Every shadow follows the same field to the player
+    rv = playstate_updateFlow(pGame, winX, winWidth);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Store where every mob is, so they can look for each other
+    rv = collide_initView(pGame, winX, winWidth, pState->height);
+    ASSERT(rv == GFMRV_OK, rv);
     i = 0;
-    while (i < 5) {
-        rv = gfmQuadtree_populateObject(pGame->pQt, pState->pWorld[i]);
+    while (i < pState->numAwake) {
+        rv = mob_populateView(pState->ppAwake[i], pGame);
         ASSERT(rv == GFMRV_OK, rv);
         
         i++;
     }
     
+    // Every shadow thinks at once; Everything else is updated on its own
+    rv = mobPool_updateShadows(pState->pMobs, pState->ppAwake,
+            pState->numAwake, pGame);
+    ASSERT(rv == GFMRV_OK, rv);
     i = 0;
-    while (i < gfmGenArr_getUsed(pState->pMobs)) {
-        mob *pMob;
+    while (i < pState->numAwake) {
+        int type;
         
-        pMob = gfmGenArr_getObject(pState->pMobs, i);
+        rv = mob_getType(&type, pState->ppAwake[i]);
+        ASSERT(rv == GFMRV_OK, rv);
+        if (type != shadow) {
+            rv = mob_update(pState->ppAwake[i], pGame);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        
+        i++;
+    }
+    
+    i = 0;
+    while (i < pState->numAwake) {
+        rv = mob_updateSprite(pState->ppAwake[i], pGame);
+        ASSERT(rv == GFMRV_OK, rv);
         
-        rv = mob_update(pMob, pGame);
+        i++;
+    }
+    
+    i = 0;
+    while (i < pState->numAwake) {
+        rv = mob_postUpdate(pState->ppAwake[i], pGame);
         ASSERT(rv == GFMRV_OK, rv);
         
         i++;
     }
     
-    rv = gfmGroup_update(pGame->pRender, pGame->pCtx);
+    // Respond to every collision found while updating the mobs
+    rv = collide_flush(pGame);
     ASSERT(rv == GFMRV_OK, rv);
     
+    // Play every sound requested by this frame's hits (at most once each)
+    rv = sfx_flush(pGame->pSfx, pGame->pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Remember which spawns were killed, so they aren't streamed in again
     i = 0;
-    while (i < gfmGenArr_getUsed(pState->pMobs)) {
+    while (i < mobPool_getActiveCount(pState->pMobs)) {
         mob *pMob;
+        int id;
         
-        pMob = gfmGenArr_getObject(pState->pMobs, i);
-        
-        rv = mob_postUpdate(pMob, pGame);
-        ASSERT(rv == GFMRV_OK, rv);
+        pMob = mobPool_getActive(pState->pMobs, i);
+        id = mob_getSpawnId(pMob);
+        if (id >= 0 && mob_isAlive(pMob) == GFMRV_FALSE) {
+            int type;
+            
+            pState->pKilled[id] = 1;
+            pState->ppSpawned[id] = 0;
+            
+            // Destroyed walls stop blocking the way
+            rv = mob_getType(&type, pMob);
+            ASSERT(rv == GFMRV_OK, rv);
+            if (type == wall) {
+                pState->isFlowDirty = 1;
+            }
+        }
         
         i++;
     }
     
-    // Add a few particles every frame
+    // Stop updating every mob that died on this frame
+    rv = mobPool_compact(pState->pMobs);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    // Add a few leaves every frame
     num = 5 + main_getPRNG(pGame) % 10;
-    while (num > 0) {
-        gfmSprite *pSpr;
-        int tile, vx, vy, rng, x, y;
-        
-        rv = gfmGroup_recycle(&pSpr, pState->pGrp);
-        ASSERT(rv == GFMRV_OK || rv == GFMRV_GROUP_MAX_SPRITES, rv);
-        if (rv == GFMRV_GROUP_MAX_SPRITES) {
-            break;
-        }
-        
-        rng = main_getPRNG(pGame);
-        if (rng < 0) rng = -rng;
-        tile = 256 + (rng % 4);
-        
-        rng = main_getPRNG(pGame);
-        if (rng < 0) rng = -rng;
-        vy = 20 + ((rng % 8) - 6);
-        
-        rng = main_getPRNG(pGame);
-        if (rng < 0) rng = -rng;
-        vx = (rng % 8) - 4;
-        
-        rv = gfm_getCameraPosition(&x, &y, pGame->pCtx);
-        ASSERT(rv == GFMRV_OK, rv);
-        
-        rng = main_getPRNG(pGame);
-        if (rng < 0) rng = -rng;
-        x += (rng % 60) * 8 - 160;
-        y = 8;
-        
-        rv = gfmGroup_setPosition(pState->pGrp, x, y);
-        ASSERT(rv == GFMRV_OK, rv);
-        rv = gfmGroup_setFrame(pState->pGrp, tile);
-        ASSERT(rv == GFMRV_OK, rv);
-        rv = gfmGroup_setVelocity(pState->pGrp, vx, vy);
+    if (num > 0) {
+        rv = particles_emitBatch(pState->pParts, pGame->pCtx, &leafEmitter,
+                num);
         ASSERT(rv == GFMRV_OK, rv);
-        
-        num--;
     }
     
     // Update particles
-    rv = gfmGroup_update(pState->pGrp, pGame->pCtx);
+    rv = particles_update(pState->pParts, pGame->pCtx);
     ASSERT(rv == GFMRV_OK, rv);
     
     rv = GFMRV_OK;
@@ -386,16 +740,25 @@ __ret:
     return rv;
 }
 
+/**
+ * Draw a paralax layer; Each layer's tile is already a pre-composited image
+ * that wraps around every 'width' pixels, so it's scrolled by blitting it at
+ * the offset and, if that leaves a gap on the right, once again after it
+ * (instead of also blitting a copy that is always off-screen)
+ */
 static gfmRV playstate_drawBG(gameCtx *pGame, int tile, int camX, int width) {
     gfmRV rv;
-    int x, y;
+    int x;
     
     camX %= width;
+    if (camX < 0) {
+        camX += width;
+    }
     
-    y = 0;
-    x = -width;
-    while (x - camX < 160) {
-        rv = gfm_drawTile(pGame->pCtx, pGame->pSset256x128, x - camX, y, tile, 0);
+    x = -camX;
+    while (x < VIEW_WIDTH) {
+        rv = gfm_drawTile(pGame->pCtx, pGame->pSset256x128, x, 0/*y*/, tile,
+                0/*isFlipped*/);
         ASSERT(rv == GFMRV_OK, rv);
         
         x += width;
@@ -406,6 +769,85 @@ __ret:
     return rv;
 }
 
+/**
+ * Order mobs from the top of the screen to its bottom
+ */
+static int playstate_cmpDepth(const void *pA, const void *pB) {
+    const psDrawable *pDrawA, *pDrawB;
+    
+    pDrawA = (const psDrawable*)pA;
+    pDrawB = (const psDrawable*)pB;
+    
+    if (pDrawA->y != pDrawB->y) {
+        return (pDrawA->y < pDrawB->y) ? -1 : 1;
+    }
+    return pDrawA->index - pDrawB->index;
+}
+
+/**
+ * Draw every mob (alive or not) on the camera, from the topmost one; Replaces
+ * drawing the whole render group, which also went through every mob outside
+ * the camera
+ */
+static gfmRV playstate_drawMobs(gameCtx *pGame) {
+    gfmRV rv;
+    int camX, camY, i, num, numVisible;
+    playstate *pState;
+    
+    pState = (playstate*)pGame->pState;
+    
+    num = mobPool_getUsed(pState->pMobs);
+    if (num > pState->visibleLen) {
+        psDrawable *pTmp;
+        
+        pTmp = (psDrawable*)realloc(pState->pVisible, sizeof(psDrawable) * num);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pState->pVisible = pTmp;
+        pState->visibleLen = num;
+    }
+    
+    rv = gfm_getCameraPosition(&camX, &camY, pGame->pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    numVisible = 0;
+    i = 0;
+    while (i < num) {
+        mob *pMob;
+        
+        pMob = mobPool_getMob(pState->pMobs, i);
+        rv = mob_isOnCamera(pMob, camX, camY, VIEW_WIDTH, VIEW_HEIGHT);
+        ASSERT(rv == GFMRV_TRUE || rv == GFMRV_FALSE, rv);
+        if (rv == GFMRV_TRUE) {
+            psDrawable *pDraw;
+            int x;
+            
+            pDraw = pState->pVisible + numVisible;
+            pDraw->pMob = pMob;
+            pDraw->index = i;
+            rv = mob_getPosition(&x, &(pDraw->y), pMob);
+            ASSERT(rv == GFMRV_OK, rv);
+            numVisible++;
+        }
+        
+        i++;
+    }
+    
+    qsort(pState->pVisible, numVisible, sizeof(psDrawable),
+            playstate_cmpDepth);
+    
+    i = 0;
+    while (i < numVisible) {
+        rv = mob_draw(pState->pVisible[i].pMob, pGame);
+        ASSERT(rv == GFMRV_OK, rv);
+        
+        i++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
 /**
  * Draws the playstate
  */
@@ -431,7 +873,7 @@ static gfmRV playstate_draw(gameCtx *pGame) {
     ASSERT(rv == GFMRV_OK, rv);
     
     // Draw particles
-    rv = gfmGroup_draw(pState->pGrp, pGame->pCtx);
+    rv = particles_draw(pState->pParts, pGame->pCtx);
     ASSERT(rv == GFMRV_OK, rv);
     
     // Draw nearest paralax
@@ -448,21 +890,8 @@ static gfmRV playstate_draw(gameCtx *pGame) {
     rv = playstate_drawBG(pGame, tile, iniX, width);
     ASSERT(rv == GFMRV_OK, rv);
     
-    rv = gfmGroup_draw(pGame->pRender, pGame->pCtx);
+    rv = playstate_drawMobs(pGame);
     ASSERT(rv == GFMRV_OK, rv);
-    /*
-    i = 0;
-    while (i < gfmGenArr_getUsed(pState->pMobs)) {
-        mob *pMob;
-        
-        pMob = gfmGenArr_getObject(pState->pMobs, i);
-        
-        rv = mob_draw(pMob, pGame);
-        ASSERT(rv == GFMRV_OK, rv);
-        
-        i++;
-    }
-    */
     
     // Draw foreground
     tile = 7;
@@ -472,8 +901,10 @@ static gfmRV playstate_draw(gameCtx *pGame) {
     ASSERT(rv == GFMRV_OK, rv);
     
 #ifdef DEBUG
-    rv = gfmQuadtree_drawBounds(pGame->pQt, pGame->pCtx, 0/*colors*/);
-    ASSERT(rv == GFMRV_OK, rv);
+    if (pGame->broadphase == broadphase_quadtree) {
+        rv = gfmQuadtree_drawBounds(pGame->pQt, pGame->pCtx, 0/*colors*/);
+        ASSERT(rv == GFMRV_OK, rv);
+    }
 #endif
     
     rv = GFMRV_OK;
@@ -490,7 +921,6 @@ gfmRV playstate_loop(gameCtx *pGame) {
     
     // Initialize the state, if needed
     if (!pGame->isInit) {
-        memset(&psCtx, 0x0, sizeof(playstate));
         pGame->pState = &psCtx;
         
         rv = playstate_init(pGame);
@@ -532,7 +962,6 @@ gfmRV playstate_loop(gameCtx *pGame) {
     
 __ret:
     if (pGame->quitState || rv != GFMRV_OK) {
-        playstate_clean(pGame);
         pGame->isInit = 0;
         pGame->quitState = 0;
     }
@@ -540,9 +969,7 @@ __ret:
     return rv;
 #else
     gfmRV rv;
-    playstate psCtx;
     
-    memset(&psCtx, 0x0, sizeof(playstate));
     pGame->pState = &psCtx;
     
     rv = playstate_init(pGame);
@@ -586,12 +1013,45 @@ __ret:
     
     rv = GFMRV_OK;
 __ret:
-    playstate_clean(pGame);
-    
     return rv;
 #endif
 }
 
+/**
+ * Burst a batch of particles out of an area (e.g., a mob that just died)
+ */
+gfmRV playstate_burst(gameCtx *pGame, int x, int y, int width, int height,
+        int num) {
+    particleEmitter burst;
+    gfmRV rv;
+    playstate *pState;
+    
+    pState = (playstate*)pGame->pState;
+    ASSERT(pState, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pState->pParts, GFMRV_ARGUMENTS_BAD);
+    
+    burst.x = x;
+    burst.y = y;
+    burst.width = width;
+    burst.height = height;
+    burst.isCameraRelative = 0;
+    burst.minVx = -64;
+    burst.maxVx = 64;
+    burst.minVy = -72;
+    burst.maxVy = 24;
+    burst.firstTile = 256;
+    burst.lastTile = 259;
+    burst.minTtl = 250;
+    burst.maxTtl = 600;
+    
+    rv = particles_emitBatch(pState->pParts, pGame->pCtx, &burst, num);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
 gfmRV playstate_setWin(gameCtx *pGame) {
     pGame->didWin = 1;
     pGame->quitState = 1;
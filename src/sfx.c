@@ -0,0 +1,305 @@
+/**
+ * @file src/sfx.c
+ *
+ * Sound effects layer; The library can't tell whether an audio has finished,
+ * so each voice is considered busy until its sound's length has elapsed
+ */
+#include <GFraMe/gframe.h>
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+
+#include <ld33/sfx.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** A sound effect's settings and its request for the current frame */
+struct stSfxSound {
+    /** Audio's handle */
+    int handle;
+    /** Sounds with greater priority may steal voices from lesser ones */
+    int priority;
+    /** How many voices of this sound may be playing at once */
+    int maxVoices;
+    /** Audio's duration, in milliseconds */
+    int length;
+    /** How many voices of this sound are playing */
+    int numVoices;
+    /** Whether it was requested since the last flush */
+    int isQueued;
+    /** Loudest volume requested since the last flush */
+    double volume;
+};
+typedef struct stSfxSound sfxSound;
+
+/** A playing sound effect */
+struct stSfxVoice {
+    /** Handle to the playing audio, so it may be stopped */
+    gfmAudioHandle *pHnd;
+    /** Which sound is playing */
+    sfxId id;
+    /** When the sound should finish (on the layer's clock) */
+    int endTime;
+};
+typedef struct stSfxVoice sfxVoice;
+
+struct stSfx {
+    /** Every sound effect */
+    sfxSound pSounds[SFX_MAX];
+    /** Voices currently playing */
+    sfxVoice *pVoices;
+    /** How many voices may be playing at once */
+    int maxVoices;
+    /** How many voices are playing */
+    int numVoices;
+    /** Milliseconds elapsed since the layer was created */
+    int time;
+    /** How many requests were merged into another one */
+    int merged;
+    /** How many requests were dropped */
+    int dropped;
+};
+
+/**
+ * Alloc a new sound effects layer
+ */
+gfmRV sfx_getNew(sfx **ppSfx, int maxVoices) {
+    gfmRV rv;
+    
+    ASSERT(ppSfx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppSfx), GFMRV_ARGUMENTS_BAD);
+    ASSERT(maxVoices > 0, GFMRV_ARGUMENTS_BAD);
+    
+    *ppSfx = (sfx*)malloc(sizeof(sfx));
+    ASSERT(*ppSfx, GFMRV_ALLOC_FAILED);
+    memset(*ppSfx, 0x0, sizeof(sfx));
+    
+    (*ppSfx)->pVoices = (sfxVoice*)malloc(sizeof(sfxVoice) * maxVoices);
+    if (!(*ppSfx)->pVoices) {
+        free(*ppSfx);
+        *ppSfx = 0;
+    }
+    ASSERT(*ppSfx, GFMRV_ALLOC_FAILED);
+    (*ppSfx)->maxVoices = maxVoices;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Free the sound effects layer's memory
+ */
+gfmRV sfx_free(sfx **ppSfx) {
+    gfmRV rv;
+    
+    ASSERT(ppSfx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppSfx, GFMRV_ARGUMENTS_BAD);
+    
+    free((*ppSfx)->pVoices);
+    free(*ppSfx);
+    *ppSfx = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Set the audio played by a sound effect and how it's limited
+ */
+gfmRV sfx_setSound(sfx *pSfx, sfxId id, int handle, int priority,
+        int maxVoices, int length) {
+    gfmRV rv;
+    sfxSound *pSound;
+    
+    ASSERT(pSfx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(id >= 0 && id < SFX_MAX, GFMRV_ARGUMENTS_BAD);
+    ASSERT(maxVoices > 0, GFMRV_ARGUMENTS_BAD);
+    ASSERT(length > 0, GFMRV_ARGUMENTS_BAD);
+    
+    pSound = &(pSfx->pSounds[id]);
+    pSound->handle = handle;
+    pSound->priority = priority;
+    pSound->maxVoices = maxVoices;
+    pSound->length = length;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Request a sound effect to be played on the next flush
+ */
+gfmRV sfx_play(sfx *pSfx, sfxId id, double volume) {
+    gfmRV rv;
+    sfxSound *pSound;
+    
+    ASSERT(pSfx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(id >= 0 && id < SFX_MAX, GFMRV_ARGUMENTS_BAD);
+    
+    pSound = &(pSfx->pSounds[id]);
+    if (pSound->isQueued) {
+        if (volume > pSound->volume) {
+            pSound->volume = volume;
+        }
+        pSfx->merged++;
+    }
+    else {
+        pSound->isQueued = 1;
+        pSound->volume = volume;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Find which voice should be stolen by a sound: the one with the least
+ * priority (and, on ties, the one closest to finishing)
+ *
+ * @return The voice's index or -1, if every voice is at least as important
+ */
+static int sfx_getStealable(sfx *pSfx, int priority) {
+    int i, victim;
+    
+    victim = -1;
+    i = 0;
+    while (i < pSfx->numVoices) {
+        sfxVoice *pVoice;
+        int cur;
+        
+        pVoice = &(pSfx->pVoices[i]);
+        cur = pSfx->pSounds[pVoice->id].priority;
+        if (cur < priority) {
+            if (victim == -1) {
+                victim = i;
+            }
+            else {
+                sfxVoice *pBest;
+                int best;
+                
+                pBest = &(pSfx->pVoices[victim]);
+                best = pSfx->pSounds[pBest->id].priority;
+                if (cur < best || (cur == best &&
+                        pVoice->endTime < pBest->endTime)) {
+                    victim = i;
+                }
+            }
+        }
+        
+        i++;
+    }
+    
+    return victim;
+}
+
+/**
+ * Play every sound requested since the last flush
+ */
+gfmRV sfx_flush(sfx *pSfx, gfmCtx *pCtx) {
+    gfmRV rv;
+    int elapsed, i;
+    
+    ASSERT(pSfx, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pCtx, GFMRV_ARGUMENTS_BAD);
+    
+    rv = gfm_getElapsedTime(&elapsed, pCtx);
+    ASSERT(rv == GFMRV_OK, rv);
+    pSfx->time += elapsed;
+    
+    // Release every voice that should have finished
+    i = 0;
+    while (i < pSfx->numVoices) {
+        sfxVoice *pVoice;
+        
+        pVoice = &(pSfx->pVoices[i]);
+        if (pVoice->endTime <= pSfx->time) {
+            pSfx->pSounds[pVoice->id].numVoices--;
+            pSfx->numVoices--;
+            *pVoice = pSfx->pVoices[pSfx->numVoices];
+            continue;
+        }
+        
+        i++;
+    }
+    
+    // Play the requested sounds, from the most important one
+    while (1) {
+        sfxSound *pSound;
+        sfxVoice *pVoice;
+        int id;
+        
+        id = -1;
+        i = 0;
+        while (i < SFX_MAX) {
+            if (pSfx->pSounds[i].isQueued && (id == -1 ||
+                    pSfx->pSounds[i].priority > pSfx->pSounds[id].priority)) {
+                id = i;
+            }
+            i++;
+        }
+        if (id == -1) {
+            break;
+        }
+        
+        pSound = &(pSfx->pSounds[id]);
+        pSound->isQueued = 0;
+        
+        if (pSound->numVoices >= pSound->maxVoices) {
+            pSfx->dropped++;
+            continue;
+        }
+        
+        if (pSfx->numVoices < pSfx->maxVoices) {
+            pVoice = &(pSfx->pVoices[pSfx->numVoices]);
+            pSfx->numVoices++;
+        }
+        else {
+            i = sfx_getStealable(pSfx, pSound->priority);
+            if (i == -1) {
+                pSfx->dropped++;
+                continue;
+            }
+            pVoice = &(pSfx->pVoices[i]);
+            
+            rv = gfm_stopAudio(pCtx, pVoice->pHnd);
+            ASSERT(rv == GFMRV_OK, rv);
+            pSfx->pSounds[pVoice->id].numVoices--;
+            pSfx->dropped++;
+        }
+        
+        pVoice->pHnd = 0;
+        rv = gfm_playAudio(&(pVoice->pHnd), pCtx, pSound->handle,
+                pSound->volume);
+        ASSERT(rv == GFMRV_OK, rv);
+        pVoice->id = (sfxId)id;
+        pVoice->endTime = pSfx->time + pSound->length;
+        pSound->numVoices++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Get how many requests were merged and how many were dropped
+ */
+gfmRV sfx_getStats(int *pMerged, int *pDropped, sfx *pSfx) {
+    gfmRV rv;
+    
+    ASSERT(pMerged, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pDropped, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pSfx, GFMRV_ARGUMENTS_BAD);
+    
+    *pMerged = pSfx->merged;
+    *pDropped = pSfx->dropped;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
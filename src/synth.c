@@ -0,0 +1,877 @@
+/**
+ * @file src/synth.c
+ *
+ * Sequencer and synthesizer for songs written in MML; Loops and macros are
+ * expanded while compiling, so rendering only has to walk each track's notes
+ */
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+
+#include <ld33/synth.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Ticks on a whole note (so dotted and triplet lengths are still integers) */
+#define SYNTH_WHOLE     192
+#define SYNTH_QUARTER   (SYNTH_WHOLE / 4)
+/** Maximum number of tracks and envelope tables */
+#define SYNTH_TRACKS    8
+#define SYNTH_TABLES    8
+/** How many times a second envelopes are stepped */
+#define SYNTH_ENV_RATE  60
+/** Loudest value of an envelope */
+#define SYNTH_ENV_MAX   128
+/** How deep loops and macros may be nested (so a recursive macro fails instead
+ * of hanging) */
+#define SYNTH_MAX_DEPTH 16
+/** Loudest sample of a single track, so a few tracks may be mixed without
+ * clipping */
+#define SYNTH_PEAK      5000
+
+/** Waves selected by '@' */
+enum enSynthWave {
+    SYNTH_SQUARE = 0,
+    SYNTH_NOISE,
+    SYNTH_TRIANGLE,
+    SYNTH_PULSE
+};
+
+/** A compiled note (or rest) */
+struct stSynthNote {
+    /** Semitones above C0 (-1, on rests) */
+    int note;
+    /** Note's duration, in ticks */
+    int ticks;
+    /** For how many of those ticks the note is heard */
+    int onTicks;
+    /** Note's wave */
+    int wave;
+    /** Note's volume (from 0 to 15) */
+    int volume;
+    /** Note's envelope (-1, if none) */
+    int env;
+};
+typedef struct stSynthNote synthNote;
+
+/** An envelope table */
+struct stSynthTable {
+    int *pValues;
+    /** How many values fit on the table */
+    int valuesLen;
+    /** How many values were parsed */
+    int numValues;
+};
+typedef struct stSynthTable synthTable;
+
+/** A track's notes and where it's being played */
+struct stSynthTrack {
+    /** Every note on the track */
+    synthNote *pNotes;
+    /** How many notes fit on the list */
+    int notesLen;
+    /** How many notes were compiled */
+    int numNotes;
+    /** Track's duration, in ticks */
+    int ticks;
+    /** Note being played */
+    int cur;
+    /** Tick where the current note started */
+    int tick;
+    /** Samples (since the song started) where the current note starts, stops
+     * being heard and ends */
+    int start;
+    int onEnd;
+    int end;
+    /** Wave's phase and how much it advances each sample */
+    unsigned int phase;
+    unsigned int inc;
+    /** Noise generator's state */
+    unsigned int lfsr;
+};
+typedef struct stSynthTrack synthTrack;
+
+struct stSynth {
+    /** Every track */
+    synthTrack pTracks[SYNTH_TRACKS];
+    /** How many tracks were compiled */
+    int numTracks;
+    /** Every envelope table */
+    synthTable pTables[SYNTH_TABLES];
+    /** Sample rate */
+    int freq;
+    /** Song's tempo, in beats per minute */
+    int tempo;
+    /** How many samples are in each tick */
+    double samplesPerTick;
+    /** Current sample, since the song (last) started */
+    int pos;
+    /** Song's length, in samples */
+    int loopLen;
+};
+
+/** Macro's source */
+struct stSynthMacro {
+    const char *pStart;
+    const char *pEnd;
+};
+typedef struct stSynthMacro synthMacro;
+
+/** State while compiling a track */
+struct stSynthParser {
+    synth *pSynth;
+    /** Track being compiled */
+    synthTrack *pTrack;
+    /** Every macro (A to Z) */
+    synthMacro pMacros[26];
+    /** Current settings, applied to every following note */
+    int octave;
+    int length;
+    int quant;
+    int volume;
+    int wave;
+    int env;
+    /** How many loops and macros are being expanded */
+    int depth;
+};
+typedef struct stSynthParser synthParser;
+
+/** Frequency of every note on the fourth octave (from C to B) */
+static const double pOctave4[12] = {
+    261.626, 277.183, 293.665, 311.127, 329.628, 349.228,
+    369.994, 391.995, 415.305, 440.000, 466.164, 493.883
+};
+
+/**
+ * Alloc a new synth
+ */
+gfmRV synth_getNew(synth **ppSynth, int freq) {
+    gfmRV rv;
+    
+    ASSERT(ppSynth, GFMRV_ARGUMENTS_BAD);
+    ASSERT(!(*ppSynth), GFMRV_ARGUMENTS_BAD);
+    ASSERT(freq > 0, GFMRV_ARGUMENTS_BAD);
+    
+    *ppSynth = (synth*)malloc(sizeof(synth));
+    ASSERT(*ppSynth, GFMRV_ALLOC_FAILED);
+    
+    memset(*ppSynth, 0x0, sizeof(synth));
+    (*ppSynth)->freq = freq;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Free the synth's memory
+ */
+gfmRV synth_free(synth **ppSynth) {
+    gfmRV rv;
+    int i;
+    
+    ASSERT(ppSynth, GFMRV_ARGUMENTS_BAD);
+    ASSERT(*ppSynth, GFMRV_ARGUMENTS_BAD);
+    
+    i = 0;
+    while (i < SYNTH_TRACKS) {
+        free((*ppSynth)->pTracks[i].pNotes);
+        i++;
+    }
+    i = 0;
+    while (i < SYNTH_TABLES) {
+        free((*ppSynth)->pTables[i].pValues);
+        i++;
+    }
+    free(*ppSynth);
+    *ppSynth = 0;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Skip any whitespace and comments
+ */
+static void synth_skip(const char **ppCur, const char *pEnd) {
+    const char *pCur;
+    
+    pCur = *ppCur;
+    while (pCur < pEnd) {
+        if (*pCur == ' ' || *pCur == '\t' || *pCur == '\r' || *pCur == '\n') {
+            pCur++;
+        }
+        else if (*pCur == '/' && pCur + 1 < pEnd && pCur[1] == '/') {
+            while (pCur < pEnd && *pCur != '\n') {
+                pCur++;
+            }
+        }
+        else {
+            break;
+        }
+    }
+    *ppCur = pCur;
+}
+
+/**
+ * Read an unsigned integer, if there's any
+ *
+ * @return 1, if a number was read; 0, otherwise
+ */
+static int synth_readInt(int *pVal, const char **ppCur, const char *pEnd) {
+    const char *pCur;
+    
+    pCur = *ppCur;
+    if (pCur >= pEnd || *pCur < '0' || *pCur > '9') {
+        return 0;
+    }
+    
+    *pVal = 0;
+    while (pCur < pEnd && *pCur >= '0' && *pCur <= '9') {
+        *pVal = (*pVal) * 10 + (*pCur) - '0';
+        pCur++;
+    }
+    *ppCur = pCur;
+    
+    return 1;
+}
+
+/**
+ * Find the next character (ignoring the ones on comments)
+ *
+ * @return The character's position or pEnd, if it wasn't found
+ */
+static const char* synth_find(const char *pCur, const char *pEnd, char c) {
+    while (pCur < pEnd && *pCur != c) {
+        if (*pCur == '/' && pCur + 1 < pEnd && pCur[1] == '/') {
+            synth_skip(&pCur, pEnd);
+        }
+        else {
+            pCur++;
+        }
+    }
+    return pCur;
+}
+
+/**
+ * Read a length (e.g., "8", "4." or nothing, for the default one)
+ */
+static gfmRV synth_readLength(int *pTicks, synthParser *pParser,
+        const char **ppCur, const char *pEnd) {
+    gfmRV rv;
+    int add, len;
+    
+    if (synth_readInt(&len, ppCur, pEnd)) {
+        ASSERT(len > 0 && len <= SYNTH_WHOLE, GFMRV_READ_ERROR);
+        *pTicks = SYNTH_WHOLE / len;
+    }
+    else {
+        *pTicks = pParser->length;
+    }
+    
+    add = (*pTicks) / 2;
+    while (*ppCur < pEnd && **ppCur == '.') {
+        *pTicks += add;
+        add /= 2;
+        (*ppCur)++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Append a note to the track being compiled
+ */
+static gfmRV synth_addNote(synthParser *pParser, int note, int ticks) {
+    gfmRV rv;
+    synthNote *pNote;
+    synthTrack *pTrack;
+    
+    pTrack = pParser->pTrack;
+    if (pTrack->numNotes >= pTrack->notesLen) {
+        synthNote *pTmp;
+        int len;
+        
+        len = pTrack->notesLen * 2;
+        if (len == 0) {
+            len = 64;
+        }
+        pTmp = (synthNote*)realloc(pTrack->pNotes, sizeof(synthNote) * len);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pTrack->pNotes = pTmp;
+        pTrack->notesLen = len;
+    }
+    
+    pNote = pTrack->pNotes + pTrack->numNotes;
+    pNote->note = note;
+    pNote->ticks = ticks;
+    pNote->onTicks = ticks * pParser->quant / 8;
+    if (pNote->onTicks < 1) {
+        pNote->onTicks = 1;
+    }
+    pNote->wave = pParser->wave;
+    pNote->volume = pParser->volume;
+    pNote->env = pParser->env;
+    
+    pTrack->numNotes++;
+    pTrack->ticks += ticks;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Parse an envelope table (i.e., "#TABLE n { ... };"), from just after its
+ * name
+ */
+static gfmRV synth_parseTable(synth *pSynth, const char **ppCur,
+        const char *pEnd) {
+    gfmRV rv;
+    synthTable *pTable;
+    const char *pCur;
+    int i, index;
+    
+    pCur = *ppCur;
+    
+    synth_skip(&pCur, pEnd);
+    ASSERT(synth_readInt(&index, &pCur, pEnd), GFMRV_READ_ERROR);
+    ASSERT(index < SYNTH_TABLES, GFMRV_READ_ERROR);
+    synth_skip(&pCur, pEnd);
+    ASSERT(pCur < pEnd && *pCur == '{', GFMRV_READ_ERROR);
+    pCur++;
+    
+    pTable = pSynth->pTables + index;
+    pTable->numValues = 0;
+    while (1) {
+        int count, first, last;
+        
+        synth_skip(&pCur, pEnd);
+        ASSERT(pCur < pEnd, GFMRV_READ_ERROR);
+        if (*pCur == '}') {
+            pCur++;
+            break;
+        }
+        
+        // Either a single value or a ramp
+        if (*pCur == '(') {
+            pCur++;
+            synth_skip(&pCur, pEnd);
+            ASSERT(synth_readInt(&first, &pCur, pEnd), GFMRV_READ_ERROR);
+            synth_skip(&pCur, pEnd);
+            ASSERT(pCur < pEnd && *pCur == ',', GFMRV_READ_ERROR);
+            pCur++;
+            synth_skip(&pCur, pEnd);
+            ASSERT(synth_readInt(&last, &pCur, pEnd), GFMRV_READ_ERROR);
+            synth_skip(&pCur, pEnd);
+            ASSERT(pCur < pEnd && *pCur == ')', GFMRV_READ_ERROR);
+            pCur++;
+            if (!synth_readInt(&count, &pCur, pEnd)) {
+                count = 1;
+            }
+            ASSERT(count > 0, GFMRV_READ_ERROR);
+        }
+        else {
+            ASSERT(synth_readInt(&first, &pCur, pEnd), GFMRV_READ_ERROR);
+            last = first;
+            count = 1;
+        }
+        ASSERT(first <= SYNTH_ENV_MAX && last <= SYNTH_ENV_MAX,
+                GFMRV_READ_ERROR);
+        
+        if (pTable->numValues + count > pTable->valuesLen) {
+            int *pTmp;
+            int len;
+            
+            len = pTable->numValues + count + 16;
+            pTmp = (int*)realloc(pTable->pValues, sizeof(int) * len);
+            ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+            pTable->pValues = pTmp;
+            pTable->valuesLen = len;
+        }
+        i = 0;
+        while (i < count) {
+            int val;
+            
+            val = first;
+            if (count > 1) {
+                val += (last - first) * i / (count - 1);
+            }
+            pTable->pValues[pTable->numValues] = val;
+            pTable->numValues++;
+            i++;
+        }
+        
+        synth_skip(&pCur, pEnd);
+        if (pCur < pEnd && *pCur == ',') {
+            pCur++;
+        }
+    }
+    
+    synth_skip(&pCur, pEnd);
+    ASSERT(pCur < pEnd && *pCur == ';', GFMRV_READ_ERROR);
+    pCur++;
+    
+    *ppCur = pCur;
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Compile a sequence of commands into the current track
+ */
+static gfmRV synth_parseSeq(synthParser *pParser, const char *pCur,
+        const char *pEnd) {
+    /** Semitone of each note, from A to G */
+    static const int pSemitones[7] = { 9, 11, 0, 2, 4, 5, 7 };
+    gfmRV rv;
+    
+    while (1) {
+        char c;
+        int val;
+        
+        synth_skip(&pCur, pEnd);
+        if (pCur >= pEnd) {
+            break;
+        }
+        c = *pCur;
+        pCur++;
+        
+        if ((c >= 'a' && c <= 'g') || c == 'r') {
+            int note, ticks, tie;
+            
+            note = -1;
+            if (c != 'r') {
+                note = pSemitones[c - 'a'];
+                while (pCur < pEnd && (*pCur == '+' || *pCur == '#' ||
+                        *pCur == '-')) {
+                    note += (*pCur == '-') ? -1 : 1;
+                    pCur++;
+                }
+                note += pParser->octave * 12;
+                ASSERT(note >= 0, GFMRV_READ_ERROR);
+            }
+            
+            rv = synth_readLength(&ticks, pParser, &pCur, pEnd);
+            ASSERT(rv == GFMRV_OK, rv);
+            while (pCur < pEnd && *pCur == '^') {
+                pCur++;
+                rv = synth_readLength(&tie, pParser, &pCur, pEnd);
+                ASSERT(rv == GFMRV_OK, rv);
+                ticks += tie;
+            }
+            
+            rv = synth_addNote(pParser, note, ticks);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        else if (c == '<') {
+            pParser->octave++;
+        }
+        else if (c == '>') {
+            ASSERT(pParser->octave > 0, GFMRV_READ_ERROR);
+            pParser->octave--;
+        }
+        else if (c == 'l') {
+            ASSERT(pCur < pEnd && *pCur >= '0' && *pCur <= '9',
+                    GFMRV_READ_ERROR);
+            rv = synth_readLength(&(pParser->length), pParser, &pCur, pEnd);
+            ASSERT(rv == GFMRV_OK, rv);
+        }
+        else if (c == 'n' && pCur < pEnd && *pCur == 'a') {
+            pCur++;
+            ASSERT(synth_readInt(&val, &pCur, pEnd), GFMRV_READ_ERROR);
+            ASSERT(val < SYNTH_TABLES, GFMRV_READ_ERROR);
+            pParser->env = val;
+        }
+        else if (c == 'o' || c == 'q' || c == 'v' || c == 't' || c == '@') {
+            ASSERT(synth_readInt(&val, &pCur, pEnd), GFMRV_READ_ERROR);
+            switch (c) {
+                case 'o': pParser->octave = val; break;
+                case 'q': {
+                    ASSERT(val > 0 && val <= 8, GFMRV_READ_ERROR);
+                    pParser->quant = val;
+                } break;
+                case 'v': {
+                    ASSERT(val <= 15, GFMRV_READ_ERROR);
+                    pParser->volume = val;
+                } break;
+                case 't': {
+                    ASSERT(val > 0, GFMRV_READ_ERROR);
+                    pParser->pSynth->tempo = val;
+                } break;
+                case '@': {
+                    ASSERT(val <= SYNTH_PULSE, GFMRV_READ_ERROR);
+                    pParser->wave = val;
+                } break;
+            }
+        }
+        else if (c == '[') {
+            const char *pBar, *pClose, *pTmp;
+            int count, depth, i;
+            
+            // Find the loop's end (and where the last iteration stops)
+            pBar = 0;
+            depth = 0;
+            pTmp = pCur;
+            while (1) {
+                synth_skip(&pTmp, pEnd);
+                ASSERT(pTmp < pEnd, GFMRV_READ_ERROR);
+                if (*pTmp == '[') {
+                    depth++;
+                }
+                else if (*pTmp == ']') {
+                    if (depth == 0) {
+                        break;
+                    }
+                    depth--;
+                }
+                else if (*pTmp == '|' && depth == 0) {
+                    pBar = pTmp;
+                }
+                pTmp++;
+            }
+            pClose = pTmp;
+            
+            pTmp++;
+            if (!synth_readInt(&count, &pTmp, pEnd)) {
+                count = 2;
+            }
+            
+            pParser->depth++;
+            ASSERT(pParser->depth <= SYNTH_MAX_DEPTH, GFMRV_READ_ERROR);
+            i = 0;
+            while (i < count) {
+                if (i == count - 1 && pBar) {
+                    rv = synth_parseSeq(pParser, pCur, pBar);
+                }
+                else if (pBar) {
+                    // Skip the bar itself
+                    rv = synth_parseSeq(pParser, pCur, pBar);
+                    ASSERT(rv == GFMRV_OK, rv);
+                    rv = synth_parseSeq(pParser, pBar + 1, pClose);
+                }
+                else {
+                    rv = synth_parseSeq(pParser, pCur, pClose);
+                }
+                ASSERT(rv == GFMRV_OK, rv);
+                i++;
+            }
+            pParser->depth--;
+            
+            pCur = pTmp;
+        }
+        else if (c >= 'A' && c <= 'Z') {
+            synthMacro *pMacro;
+            
+            pMacro = pParser->pMacros + (c - 'A');
+            ASSERT(pMacro->pStart, GFMRV_READ_ERROR);
+            
+            pParser->depth++;
+            ASSERT(pParser->depth <= SYNTH_MAX_DEPTH, GFMRV_READ_ERROR);
+            rv = synth_parseSeq(pParser, pMacro->pStart, pMacro->pEnd);
+            ASSERT(rv == GFMRV_OK, rv);
+            pParser->depth--;
+        }
+        else {
+            ASSERT(0, GFMRV_READ_ERROR);
+        }
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Set up a track's current note, from the tick where it starts
+ */
+static void synth_startNote(synth *pSynth, synthTrack *pTrack) {
+    synthNote *pNote;
+    double freq;
+    int i;
+    
+    pNote = pTrack->pNotes + pTrack->cur;
+    
+    pTrack->start = (int)(pTrack->tick * pSynth->samplesPerTick);
+    pTrack->onEnd = (int)((pTrack->tick + pNote->onTicks) *
+            pSynth->samplesPerTick);
+    pTrack->end = (int)((pTrack->tick + pNote->ticks) *
+            pSynth->samplesPerTick);
+    
+    if (pNote->note < 0) {
+        return;
+    }
+    
+    freq = pOctave4[pNote->note % 12];
+    i = pNote->note / 12;
+    while (i < 4) {
+        freq *= 0.5;
+        i++;
+    }
+    while (i > 4) {
+        freq *= 2.0;
+        i--;
+    }
+    // Noise is clocked faster than its note, so it sounds like hiss
+    if (pNote->wave == SYNTH_NOISE) {
+        freq *= 16.0;
+    }
+    freq = freq * 4294967296.0 / pSynth->freq;
+    if (freq > 4294967295.0) {
+        freq = 4294967295.0;
+    }
+    pTrack->inc = (unsigned int)freq;
+}
+
+/**
+ * Restart the song
+ */
+static void synth_rewind(synth *pSynth) {
+    int i;
+    
+    pSynth->pos = 0;
+    i = 0;
+    while (i < pSynth->numTracks) {
+        synthTrack *pTrack;
+        
+        pTrack = pSynth->pTracks + i;
+        pTrack->cur = 0;
+        pTrack->tick = 0;
+        pTrack->phase = 0;
+        pTrack->lfsr = 0x7fff;
+        synth_startNote(pSynth, pTrack);
+        
+        i++;
+    }
+}
+
+/**
+ * Compile a song
+ */
+gfmRV synth_compile(synth *pSynth, char *pText, int len) {
+    gfmRV rv;
+    synthParser parser;
+    const char *pCur, *pEnd;
+    int i, ticks;
+    
+    ASSERT(pSynth, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pText, GFMRV_ARGUMENTS_BAD);
+    ASSERT(len >= 0, GFMRV_ARGUMENTS_BAD);
+    
+    memset(&parser, 0x0, sizeof(synthParser));
+    parser.pSynth = pSynth;
+    pSynth->numTracks = 0;
+    pSynth->tempo = 120;
+    i = 0;
+    while (i < SYNTH_TABLES) {
+        pSynth->pTables[i].numValues = 0;
+        i++;
+    }
+    
+    pCur = pText;
+    pEnd = pText + len;
+    while (1) {
+        const char *pSemi;
+        synthTrack *pTrack;
+        
+        synth_skip(&pCur, pEnd);
+        if (pCur >= pEnd) {
+            break;
+        }
+        
+        if (*pCur == '#') {
+            pCur++;
+            if (pEnd - pCur > 5 && strncmp(pCur, "TABLE", 5) == 0) {
+                pCur += 5;
+                rv = synth_parseTable(pSynth, &pCur, pEnd);
+                ASSERT(rv == GFMRV_OK, rv);
+            }
+            else {
+                synthMacro *pMacro;
+                
+                ASSERT(pEnd - pCur > 1 && *pCur >= 'A' && *pCur <= 'Z' &&
+                        pCur[1] == '=', GFMRV_READ_ERROR);
+                pMacro = parser.pMacros + (*pCur - 'A');
+                pMacro->pStart = pCur + 2;
+                pMacro->pEnd = synth_find(pMacro->pStart, pEnd, ';');
+                ASSERT(pMacro->pEnd < pEnd, GFMRV_READ_ERROR);
+                pCur = pMacro->pEnd + 1;
+            }
+            continue;
+        }
+        
+        // Anything else is a track, up to the next ';'
+        ASSERT(pSynth->numTracks < SYNTH_TRACKS, GFMRV_READ_ERROR);
+        pTrack = pSynth->pTracks + pSynth->numTracks;
+        pTrack->numNotes = 0;
+        pTrack->ticks = 0;
+        
+        parser.pTrack = pTrack;
+        parser.octave = 4;
+        parser.length = SYNTH_QUARTER;
+        parser.quant = 8;
+        parser.volume = 10;
+        parser.wave = SYNTH_SQUARE;
+        parser.env = -1;
+        parser.depth = 0;
+        
+        pSemi = synth_find(pCur, pEnd, ';');
+        rv = synth_parseSeq(&parser, pCur, pSemi);
+        ASSERT(rv == GFMRV_OK, rv);
+        // Tracks that only set something (e.g., the tempo) are dropped
+        if (pTrack->numNotes > 0) {
+            pSynth->numTracks++;
+        }
+        
+        pCur = pSemi;
+        if (pCur < pEnd) {
+            pCur++;
+        }
+    }
+    
+    // The song loops after its longest track
+    pSynth->samplesPerTick = (double)pSynth->freq * 60.0 /
+            (pSynth->tempo * SYNTH_QUARTER);
+    ticks = 0;
+    i = 0;
+    while (i < pSynth->numTracks) {
+        if (pSynth->pTracks[i].ticks > ticks) {
+            ticks = pSynth->pTracks[i].ticks;
+        }
+        i++;
+    }
+    pSynth->loopLen = (int)(ticks * pSynth->samplesPerTick);
+    
+    synth_rewind(pSynth);
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Render the next samples of the song
+ */
+gfmRV synth_render(synth *pSynth, short *pBuf, int num) {
+    gfmRV rv;
+    int i;
+    
+    ASSERT(pSynth, GFMRV_ARGUMENTS_BAD);
+    ASSERT(pBuf, GFMRV_ARGUMENTS_BAD);
+    ASSERT(num >= 0, GFMRV_ARGUMENTS_BAD);
+    
+    if (pSynth->loopLen <= 0) {
+        memset(pBuf, 0x0, sizeof(short) * num);
+        rv = GFMRV_OK;
+        goto __ret;
+    }
+    
+    i = 0;
+    while (i < num) {
+        int mix, t;
+        
+        mix = 0;
+        t = 0;
+        while (t < pSynth->numTracks) {
+            synthTrack *pTrack;
+            synthNote *pNote;
+            int amp, env, sample;
+            
+            pTrack = pSynth->pTracks + t;
+            t++;
+            
+            // Move to the note being played (if the track hasn't finished)
+            while (pTrack->cur < pTrack->numNotes &&
+                    pSynth->pos >= pTrack->end) {
+                pTrack->tick += pTrack->pNotes[pTrack->cur].ticks;
+                pTrack->cur++;
+                if (pTrack->cur < pTrack->numNotes) {
+                    synth_startNote(pSynth, pTrack);
+                }
+            }
+            if (pTrack->cur >= pTrack->numNotes) {
+                continue;
+            }
+            pNote = pTrack->pNotes + pTrack->cur;
+            if (pNote->note < 0 || pSynth->pos >= pTrack->onEnd) {
+                continue;
+            }
+            
+            env = SYNTH_ENV_MAX;
+            if (pNote->env >= 0 && pSynth->pTables[pNote->env].numValues > 0) {
+                synthTable *pTable;
+                int step;
+                
+                pTable = pSynth->pTables + pNote->env;
+                step = (pSynth->pos - pTrack->start) * SYNTH_ENV_RATE /
+                        pSynth->freq;
+                if (step >= pTable->numValues) {
+                    step = pTable->numValues - 1;
+                }
+                env = pTable->pValues[step];
+            }
+            amp = SYNTH_PEAK * pNote->volume * env / (15 * SYNTH_ENV_MAX);
+            
+            switch (pNote->wave) {
+                case SYNTH_NOISE: {
+                    unsigned int prev;
+                    
+                    prev = pTrack->phase;
+                    pTrack->phase += pTrack->inc;
+                    if (pTrack->phase < prev) {
+                        unsigned int bit;
+                        
+                        bit = (pTrack->lfsr ^ (pTrack->lfsr >> 1)) & 1;
+                        pTrack->lfsr = (pTrack->lfsr >> 1) | (bit << 14);
+                    }
+                    sample = (pTrack->lfsr & 1) ? amp : -amp;
+                } break;
+                case SYNTH_TRIANGLE: {
+                    int val;
+                    
+                    val = (int)(pTrack->phase >> 16);
+                    if (val < 0x8000) {
+                        val = val * 2 - 0x8000;
+                    }
+                    else {
+                        val = (0xffff - val) * 2 - 0x8000;
+                    }
+                    sample = amp * val / 0x8000;
+                    pTrack->phase += pTrack->inc;
+                } break;
+                case SYNTH_PULSE: {
+                    sample = (pTrack->phase < 0x40000000) ? amp : -amp;
+                    pTrack->phase += pTrack->inc;
+                } break;
+                default: {
+                    sample = (pTrack->phase < 0x80000000) ? amp : -amp;
+                    pTrack->phase += pTrack->inc;
+                }
+            }
+            mix += sample;
+        }
+        
+        if (mix > 32767) {
+            mix = 32767;
+        }
+        else if (mix < -32768) {
+            mix = -32768;
+        }
+        pBuf[i] = (short)mix;
+        
+        pSynth->pos++;
+        if (pSynth->pos >= pSynth->loopLen) {
+            synth_rewind(pSynth);
+        }
+        i++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
@@ -0,0 +1,337 @@
+/**
+ * @file tools/mapc.c
+ *
+ * Map compiler; Converts a text map (as exported to assets/map.gfm) into the
+ * binary layout described on include/ld33/levelfmt.h
+ *
+ * Usage: mapc <input.gfm> <output.bin>
+ */
+#include <GFraMe/gfmAssert.h>
+#include <GFraMe/gfmError.h>
+
+#include <ld33/levelfmt.h>
+#include <ld33/mob.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Growable list of fields, written to the output as is */
+struct stFieldList {
+    int *pData;
+    int len;
+    int used;
+};
+typedef struct stFieldList fieldList;
+
+/**
+ * Append a field to a list
+ */
+static gfmRV mapc_push(fieldList *pList, int val) {
+    gfmRV rv;
+    
+    if (pList->used >= pList->len) {
+        int *pTmp;
+        
+        pList->len = pList->len * 2 + 64;
+        pTmp = (int*)realloc(pList->pData, sizeof(int) * pList->len);
+        ASSERT(pTmp, GFMRV_ALLOC_FAILED);
+        pList->pData = pTmp;
+    }
+    
+    pList->pData[pList->used] = val;
+    pList->used++;
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Write every field from a list as little-endian 32 bits integers
+ */
+static gfmRV mapc_write(FILE *pFp, fieldList *pList) {
+    gfmRV rv;
+    int i;
+    
+    i = 0;
+    while (i < pList->used) {
+        unsigned char pBuf[LVL_FIELD_SIZE];
+        unsigned int val;
+        
+        val = (unsigned int)pList->pData[i];
+        pBuf[0] = val & 0xff;
+        pBuf[1] = (val >> 8) & 0xff;
+        pBuf[2] = (val >> 16) & 0xff;
+        pBuf[3] = (val >> 24) & 0xff;
+        
+        ASSERT(fwrite(pBuf, LVL_FIELD_SIZE, 1, pFp) == 1, GFMRV_INTERNAL_ERROR);
+        i++;
+    }
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Retrieve the next token from the map and convert it to an integer
+ */
+static gfmRV mapc_getInt(int *pVal) {
+    gfmRV rv;
+    char *pTok, *pEnd;
+    
+    pTok = strtok(0, " \t\r\n");
+    ASSERT(pTok, GFMRV_READ_ERROR);
+    
+    *pVal = (int)strtol(pTok, &pEnd, 10);
+    ASSERT(*pEnd == '\0', GFMRV_READ_ERROR);
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Parse an object's properties (e.g., "[ level , 2 ]") into a spawn record
+ *
+ * @param  pLevel, ... Record's fields, which may be overwritten
+ * @param  ppTok       The token just after the properties
+ */
+static gfmRV mapc_parseProperties(char **ppTok, int *pLevel, int *pSubtype,
+        int *pTraits, int *pDist) {
+    gfmRV rv;
+    char *pTok;
+    
+    pTok = strtok(0, " \t\r\n");
+    while (pTok && strcmp(pTok, "[") == 0) {
+        char *pKey, *pVal;
+        
+        pKey = strtok(0, " \t\r\n");
+        ASSERT(pKey, GFMRV_READ_ERROR);
+        pTok = strtok(0, " \t\r\n");
+        ASSERT(pTok && strcmp(pTok, ",") == 0, GFMRV_READ_ERROR);
+        pVal = strtok(0, " \t\r\n");
+        ASSERT(pVal, GFMRV_READ_ERROR);
+        pTok = strtok(0, " \t\r\n");
+        ASSERT(pTok && strcmp(pTok, "]") == 0, GFMRV_READ_ERROR);
+
+#define CHECK_KEY(str) strcmp(pKey, str) == 0
+#define CHECK_VAL(str) strcmp(pVal, str) == 0
+        if (CHECK_KEY("level")) {
+            *pLevel = atoi(pVal);
+        }
+        else if (CHECK_KEY("subtype")) {
+            if (CHECK_VAL("slime")) *pSubtype = EN_SLIME;
+            else if (CHECK_VAL("angrySlime")) *pSubtype = EN_ANGRYSLIME;
+            else if (CHECK_VAL("swarmSlime")) *pSubtype = EN_SWARMSLIME;
+            else ASSERT(0, GFMRV_READ_ERROR);
+        }
+        else if (CHECK_KEY("trait")) {
+            if (CHECK_VAL("coward")) *pTraits |= TR_COWARD;
+            else if (CHECK_VAL("neutral")) *pTraits |= TR_NEUTRAL;
+            else if (CHECK_VAL("angry")) *pTraits |= TR_ANGRY;
+            else if (CHECK_VAL("swarmer")) *pTraits |= TR_SWARMER;
+            else ASSERT(0, GFMRV_READ_ERROR);
+        }
+        else if (CHECK_KEY("dist")) {
+            *pDist = atoi(pVal);
+        }
+        else {
+            ASSERT(0, GFMRV_READ_ERROR);
+        }
+#undef CHECK_VAL
+#undef CHECK_KEY
+
+        pTok = strtok(0, " \t\r\n");
+    }
+    
+    *ppTok = pTok;
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+/**
+ * Parse every record on the map
+ */
+static gfmRV mapc_parse(fieldList *pHeader, fieldList *pAreas,
+        fieldList *pSpawns, char *pMap) {
+    gfmRV rv;
+    char *pTok;
+    int height, numAreas, numSpawns, width;
+    
+    width = 0;
+    height = 120;
+    numAreas = 0;
+    numSpawns = 0;
+    
+    pTok = strtok(pMap, " \t\r\n");
+    while (pTok) {
+        char *pType;
+        int h, w, x, y;
+        
+        pType = strtok(0, " \t\r\n");
+        ASSERT(pType, GFMRV_READ_ERROR);
+        rv = mapc_getInt(&x);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = mapc_getInt(&y);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = mapc_getInt(&w);
+        ASSERT(rv == GFMRV_OK, rv);
+        rv = mapc_getInt(&h);
+        ASSERT(rv == GFMRV_OK, rv);
+
+#define CHECK_TYPE(str) strcmp(pType, str) == 0
+        if (strcmp(pTok, "area") == 0) {
+            int type;
+            
+            if (CHECK_TYPE("win")) {
+                type = LVL_AREA_WIN;
+            }
+            else if (CHECK_TYPE("collideable")) {
+                type = LVL_AREA_COLLIDEABLE;
+                
+                // Get the world's dimensions
+                if (w > width) {
+                    width = w;
+                }
+            }
+            else {
+                ASSERT(0, GFMRV_READ_ERROR);
+            }
+            
+            rv = mapc_push(pAreas, type);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pAreas, x);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pAreas, y);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pAreas, w);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pAreas, h);
+            ASSERT(rv == GFMRV_OK, rv);
+            numAreas++;
+            
+            pTok = strtok(0, " \t\r\n");
+        }
+        else if (strcmp(pTok, "obj") == 0) {
+            int dist, level, subtype, traits, type;
+            
+            dist = 48;
+            level = 1;
+            subtype = EN_NONE;
+            traits = TR_NONE;
+            
+            if (CHECK_TYPE("player")) type = LVL_OBJ_PLAYER;
+            else if (CHECK_TYPE("shadow")) type = LVL_OBJ_SHADOW;
+            else if (CHECK_TYPE("wall")) type = LVL_OBJ_WALL;
+            else ASSERT(0, GFMRV_READ_ERROR);
+            
+            rv = mapc_parseProperties(&pTok, &level, &subtype, &traits, &dist);
+            ASSERT(rv == GFMRV_OK, rv);
+            
+            rv = mapc_push(pSpawns, type);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pSpawns, x);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pSpawns, y);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pSpawns, level);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pSpawns, subtype);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pSpawns, traits);
+            ASSERT(rv == GFMRV_OK, rv);
+            rv = mapc_push(pSpawns, dist);
+            ASSERT(rv == GFMRV_OK, rv);
+            numSpawns++;
+        }
+        else {
+            ASSERT(0, GFMRV_READ_ERROR);
+        }
+#undef CHECK_TYPE
+    }
+    
+    rv = mapc_push(pHeader, LVL_MAGIC);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mapc_push(pHeader, LVL_VERSION);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mapc_push(pHeader, width);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mapc_push(pHeader, height);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mapc_push(pHeader, numAreas);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mapc_push(pHeader, numSpawns);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    rv = GFMRV_OK;
+__ret:
+    return rv;
+}
+
+int main(int argc, char *argv[]) {
+    fieldList areas, header, spawns;
+    FILE *pIn, *pOut;
+    gfmRV rv;
+    char *pMap;
+    long len;
+    
+    pIn = 0;
+    pOut = 0;
+    pMap = 0;
+    memset(&areas, 0x0, sizeof(fieldList));
+    memset(&header, 0x0, sizeof(fieldList));
+    memset(&spawns, 0x0, sizeof(fieldList));
+    
+    ASSERT(argc == 3, GFMRV_ARGUMENTS_BAD);
+    
+    // Read the whole map
+    pIn = fopen(argv[1], "rb");
+    ASSERT(pIn, GFMRV_FILE_NOT_FOUND);
+    ASSERT(fseek(pIn, 0, SEEK_END) == 0, GFMRV_READ_ERROR);
+    len = ftell(pIn);
+    ASSERT(len >= 0, GFMRV_READ_ERROR);
+    ASSERT(fseek(pIn, 0, SEEK_SET) == 0, GFMRV_READ_ERROR);
+    
+    pMap = (char*)malloc(len + 1);
+    ASSERT(pMap, GFMRV_ALLOC_FAILED);
+    ASSERT(fread(pMap, 1, len, pIn) == (size_t)len, GFMRV_READ_ERROR);
+    pMap[len] = '\0';
+    
+    rv = mapc_parse(&header, &areas, &spawns, pMap);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    pOut = fopen(argv[2], "wb");
+    ASSERT(pOut, GFMRV_INTERNAL_ERROR);
+    rv = mapc_write(pOut, &header);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mapc_write(pOut, &areas);
+    ASSERT(rv == GFMRV_OK, rv);
+    rv = mapc_write(pOut, &spawns);
+    ASSERT(rv == GFMRV_OK, rv);
+    
+    printf("%s: %i areas, %i spawns\n", argv[2], header.pData[4],
+            header.pData[5]);
+    
+    rv = GFMRV_OK;
+__ret:
+    if (rv != GFMRV_OK) {
+        printf("Usage: %s <input.gfm> <output.bin>\n"
+               "Failed to compile the map (error %i)\n", argv[0], rv);
+    }
+    if (pIn) {
+        fclose(pIn);
+    }
+    if (pOut) {
+        fclose(pOut);
+    }
+    free(pMap);
+    free(areas.pData);
+    free(header.pData);
+    free(spawns.pData);
+    
+    return rv;
+}
+